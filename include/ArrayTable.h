@@ -2,9 +2,13 @@
 #define ARRAYTABLE_H_
 
 #include <cstring> // memset
+#include <utility>
 
 #include <coat/Struct.h>
 
+#include "Memory.h"
+#include "RowIds.h"
+
 
 template<typename T>
 class ArrayTable final {
@@ -17,23 +21,40 @@ class ArrayTable final {
 DECLARE_PRIVATE(MEMBERS)
 #undef MEMBERS
 
+	// memory is not released when mapped from index cache
+	bool owned=true;
 
 public:
-	ArrayTable(T min, T max) : min(min), max(max), arr(new T[max - min + 1]) {
+	ArrayTable(T min, T max) : min(min), max(max), arr((T*)allocateMemory((max - min + 1) * sizeof(T))) {
 		memset(arr, 0xff, (max-min+1) * sizeof(T));
 	}
-	ArrayTable(T min, T max, T *col, size_t size) : ArrayTable(min, max) {
+	// wrap existing array, e.g., mapped from the index cache
+	ArrayTable(T min, T max, T *arr) : min(min), max(max), arr(arr), owned(false) {}
+	template<typename C>
+	ArrayTable(T min, T max, const C &col, size_t size) : ArrayTable(min, max, col, size, AllRows{}) {}
+	// only some rows, key of row rowids[i] is col[i]
+	template<typename C, typename R>
+	ArrayTable(T min, T max, const C &col, size_t size, const R &rowids) : ArrayTable(min, max) {
 		for(size_t i=0; i<size; ++i){
-			arr[col[i] - min] = i;
+			arr[col[i] - min] = rowids[i];
 		}
 	}
 	~ArrayTable(){
-		delete[] arr;
+		if(owned) freeMemory(arr, getArraySize() * sizeof(T));
 	}
 
 	void insert(size_t key, T data){
 		arr[key - min] = data;
 	}
+	// larger domain, keeps contained keys
+	void grow(T newmin, T newmax){
+		ArrayTable larger(newmin, newmax);
+		memcpy(larger.arr + (min - newmin), arr, getArraySize() * sizeof(T));
+		std::swap(min, larger.min);
+		std::swap(max, larger.max);
+		std::swap(arr, larger.arr);
+		std::swap(owned, larger.owned);
+	}
 
 	T lookup(size_t key) const {
 		// bounds checking
@@ -46,6 +67,11 @@ public:
 	constexpr T end() const {
 		return std::numeric_limits<T>::max();
 	}
+
+	T getMin() const { return min; }
+	T getMax() const { return max; }
+	const T *getArray() const { return arr; }
+	size_t getArraySize() const { return max - min + 1; }
 };
 
 
@@ -1,10 +1,12 @@
 #ifndef BITSETTABLE_H_
 #define BITSETTABLE_H_
 
-#include <cstdlib> // calloc, free
+#include <cstdlib>
 
 #include <coat/Struct.h>
 
+#include "Memory.h"
+
 
 class BitsetTable final {
 
@@ -16,28 +18,86 @@ class BitsetTable final {
 DECLARE_PRIVATE(MEMBERS)
 #undef MEMBERS
 
+	// memory is not released when mapped from index cache
+	bool owned=true;
+
 public:
 	BitsetTable() : min(0), max(0), data(nullptr) {}
 	BitsetTable(uint64_t min, uint64_t max)
-		: min(min), max(max), data((uint64_t*)calloc((max-min+1)/64 +1, sizeof(uint64_t)))
+		: min(min), max(max), data((uint64_t*)allocateMemory(getDataSize() * sizeof(uint64_t), true))
 		{}
 
-	void init(uint64_t min, uint64_t max, uint64_t *col, uint64_t size){
+	// returns number of distinct values in column, threads > 1 sets bits in parallel
+	template<typename C>
+	uint64_t init(uint64_t min, uint64_t max, const C &col, uint64_t size, unsigned threads=1){
 		this->min = min;
 		this->max = max;
-		data = (uint64_t*)calloc((max-min+1)/64 +1, sizeof(uint64_t));
+		data = (uint64_t*)allocateMemory(getDataSize() * sizeof(uint64_t), true);
+		uint64_t duplicates=0;
+		if(threads > 1){
+			#pragma omp parallel for schedule(static) reduction(+:duplicates) num_threads(threads)
+			for(uint64_t i=0; i<size; ++i){
+				uint64_t key = col[i] - min;
+				uint64_t bit = 1ULL << (key % 64);
+				// only the first thread setting a bit sees it unset
+				duplicates += (__atomic_fetch_or(data + key / 64, bit, __ATOMIC_RELAXED) & bit) != 0;
+			}
+			return size - duplicates;
+		}
 		for(uint64_t i=0; i<size; ++i){
-			insert(col[i]);
+			uint64_t key = col[i] - min;
+			uint64_t bit = 1ULL << (key % 64);
+			// count bits which were already set
+			duplicates += (data[key / 64] & bit) != 0;
+			data[key / 64] |= bit;
 		}
+		return size - duplicates;
+	}
+
+	// wrap existing bitset, e.g., mapped from the index cache
+	void attach(uint64_t min, uint64_t max, uint64_t *data){
+		this->min = min;
+		this->max = max;
+		this->data = data;
+		owned = false;
 	}
 
 	~BitsetTable(){
-		free(data);
+		if(owned) freeMemory(data, getDataSize() * sizeof(uint64_t));
 	}
 
-	void insert(uint64_t key){
+	// returns true if key was not contained before
+	bool insert(uint64_t key){
 		key -= min;
-		data[key / 64] |= 1ULL << (key % 64);
+		const uint64_t bit = 1ULL << (key % 64);
+		const bool added = (data[key / 64] & bit) == 0;
+		data[key / 64] |= bit;
+		return added;
+	}
+	// same as insert(), for threads filling the bitset concurrently
+	bool insertAtomic(uint64_t key){
+		key -= min;
+		const uint64_t bit = 1ULL << (key % 64);
+		uint64_t *word = data + key / 64;
+		// bits are only ever set, a plain load skips the locked RMW for duplicates and keeps the line shared
+		if(__atomic_load_n(word, __ATOMIC_RELAXED) & bit) return false;
+		return (__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit) == 0;
+	}
+	// larger domain, keeps contained keys
+	void grow(uint64_t newmin, uint64_t newmax){
+		const uint64_t oldmin = min;
+		const size_t oldsize = getDataSize();
+		uint64_t *olddata = data;
+		min = newmin;
+		max = newmax;
+		data = (uint64_t*)allocateMemory(getDataSize() * sizeof(uint64_t), true);
+		for(size_t w=0; w<oldsize; ++w){
+			for(uint64_t bits=olddata[w]; bits; bits &= bits - 1){
+				insert(oldmin + w*64 + __builtin_ctzll(bits));
+			}
+		}
+		if(owned) freeMemory(olddata, oldsize * sizeof(uint64_t));
+		owned = true;
 	}
 	bool lookup(uint64_t key) const {
 		// key could be out-of-bounds, larger domain on probe side
@@ -45,6 +105,15 @@ public:
 		key -= min;
 		return data[key / 64] & (1ULL << (key % 64));
 	}
+	// same interface as HashTable
+	bool check(uint64_t key) const {
+		return lookup(key);
+	}
+
+	uint64_t getMin() const { return min; }
+	uint64_t getMax() const { return max; }
+	const uint64_t *getData() const { return data; }
+	size_t getDataSize() const { return (max-min+1)/64 +1; }
 };
 
 
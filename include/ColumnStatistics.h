@@ -0,0 +1,180 @@
+#ifndef COLUMNSTATISTICS_H_
+#define COLUMNSTATISTICS_H_
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+
+// statistics of a column for selectivity estimation, fixed size to be stored in the index cache
+struct ColumnStatistics{
+	static constexpr unsigned buckets = 64;
+	static constexpr unsigned sample_limit = 4096;
+	static constexpr unsigned register_bits = 11;
+	static constexpr unsigned registers = 1 << register_bits;
+	static constexpr unsigned max_hitters = 8;
+
+	uint64_t size;
+	// equi-depth histogram from a sample, bucket i covers [bounds[i], bounds[i+1]]
+	// first and last bound are the exact min and max of the column
+	uint64_t bounds[buckets+1];
+	// values occurring in more than a bucket's share of the sample, count extrapolated to the column
+	struct { uint64_t value; uint64_t count; } hitters[max_hitters];
+	uint64_t num_hitters;
+	// HyperLogLog sketch over all values
+	uint8_t hll[registers];
+
+	static uint64_t hash(uint64_t key){
+		// finalizer of MurmurHash3
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdULL;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53ULL;
+		key ^= key >> 33;
+		return key;
+	}
+
+	static void addToSketch(uint8_t *regs, uint64_t value){
+		const uint64_t h = hash(value);
+		// leading zeros of the remaining bits, plus one
+		const uint8_t rank = __builtin_clzll((h << register_bits) | (1ULL << (register_bits - 1))) + 1;
+		uint8_t &reg = regs[h >> (64 - register_bits)];
+		if(reg < rank) reg = rank;
+	}
+
+	// empty sketch, filled by the caller with addToSketch() while scanning the column, e.g., for min/max
+	void init(uint64_t size){
+		this->size = size;
+		std::fill(hll, hll + registers, 0);
+	}
+	// sketch of a part of the column, e.g., of another thread
+	void mergeSketch(const uint8_t *regs){
+		for(unsigned r=0; r<registers; ++r){
+			if(hll[r] < regs[r]) hll[r] = regs[r];
+		}
+	}
+
+	// histogram and heavy hitters from a sample of the column, min and max of the whole column
+	template<typename C>
+	void buildSample(const C &col, uint64_t min, uint64_t max){
+		// every n-th value, sorted
+		const uint64_t samples = std::min<uint64_t>(size, sample_limit);
+		std::vector<uint64_t> sample(samples);
+		for(uint64_t i=0; i<samples; ++i){
+			sample[i] = col[i * size / samples];
+		}
+		std::sort(sample.begin(), sample.end());
+		for(unsigned b=0; b<=buckets; ++b){
+			bounds[b] = samples ? sample[std::min<uint64_t>(b * samples / buckets, samples - 1)] : 0;
+		}
+		// sample can miss the smallest and largest values
+		if(samples){
+			bounds[0] = min;
+			bounds[buckets] = max;
+		}
+
+		// runs of equal values in sorted sample, keep the longest ones above the threshold
+		num_hitters = 0;
+		memset(hitters, 0, sizeof(hitters));
+		const uint64_t threshold = samples / buckets;
+		for(uint64_t begin=0, end; begin<samples; begin=end){
+			for(end=begin+1; end<samples && sample[end]==sample[begin]; ++end);
+			const uint64_t run = end - begin;
+			if(run <= threshold) continue;
+			const uint64_t count = run * size / samples;
+			if(num_hitters < max_hitters){
+				hitters[num_hitters++] = {sample[begin], count};
+			}else{
+				auto smallest = std::min_element(hitters, hitters + max_hitters, [](const auto &a, const auto &b){ return a.count < b.count; });
+				if(smallest->count < count){
+					*smallest = {sample[begin], count};
+				}
+			}
+		}
+	}
+
+	// values [begin, end) were added to the column
+	// sketch is exact, histogram and heavy hitters keep the initial sample, scaled to the new size
+	template<typename C>
+	void append(const C &col, uint64_t begin, uint64_t end){
+		if(size == 0 && begin < end){
+			std::fill(bounds, bounds + buckets + 1, uint64_t(col[begin]));
+		}
+		for(uint64_t i=begin; i<end; ++i){
+			const uint64_t value = col[i];
+			addToSketch(hll, value);
+			if(value < bounds[0]) bounds[0] = value;
+			if(value > bounds[buckets]) bounds[buckets] = value;
+		}
+		for(uint64_t i=0; i<num_hitters; ++i){
+			hitters[i].count = size ? hitters[i].count * end / size : 0;
+		}
+		size = end;
+	}
+
+	double estimateDistinct() const {
+		const double m = registers;
+		double sum = 0;
+		unsigned zeros = 0;
+		for(unsigned i=0; i<registers; ++i){
+			sum += std::ldexp(1.0, -hll[i]);
+			zeros += hll[i] == 0;
+		}
+		double estimate = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+		if(estimate <= 2.5 * m && zeros > 0){
+			// linear counting for small cardinalities
+			estimate = m * std::log(m / zeros);
+		}
+		return std::min(estimate, double(size));
+	}
+
+	// fraction of tuples equal to value, at least one tuple within [min, max]
+	double selectivityEqual(uint64_t value) const {
+		if(size == 0 || value < bounds[0] || value > bounds[buckets]) return 0.0;
+		return std::max(estimateEqual(value), 1.0 / size);
+	}
+
+	// fraction of tuples less than value, at least the min and never the max within (min, max]
+	double selectivityLess(uint64_t value) const {
+		if(size == 0 || value <= bounds[0]) return 0.0;
+		if(value > bounds[buckets]) return 1.0;
+		return std::clamp(estimateLess(value), 1.0 / size, 1.0 - 1.0 / size);
+	}
+
+	// fraction of tuples greater than value, at least the max and never the min within [min, max)
+	double selectivityGreater(uint64_t value) const {
+		if(size == 0 || value >= bounds[buckets]) return 0.0;
+		if(value < bounds[0]) return 1.0;
+		const double less = value > bounds[0] ? estimateLess(value) : 0.0;
+		return std::clamp(1.0 - less - estimateEqual(value), 1.0 / size, 1.0 - 1.0 / size);
+	}
+
+private:
+	// estimates for values within [min, max]
+	double estimateEqual(uint64_t value) const {
+		uint64_t hitterCount = 0;
+		for(uint64_t i=0; i<num_hitters; ++i){
+			if(hitters[i].value == value){
+				return double(hitters[i].count) / size;
+			}
+			hitterCount += hitters[i].count;
+		}
+		// remaining tuples spread evenly over remaining distinct values
+		const double rest = std::max(1.0, estimateDistinct() - num_hitters);
+		return std::max(0.0, 1.0 - double(hitterCount) / size) / rest;
+	}
+
+	// value above min
+	double estimateLess(uint64_t value) const {
+		// first bound not less than value, bucket before it contains value
+		const unsigned b = std::lower_bound(bounds, bounds + buckets + 1, value) - bounds;
+		const uint64_t lo = bounds[b-1], hi = bounds[b];
+		// linear interpolation within bucket
+		const double within = hi > lo ? double(value - lo) / double(hi - lo) : 0.0;
+		return (b - 1 + within) / buckets;
+	}
+};
+
+#endif
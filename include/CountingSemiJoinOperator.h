@@ -0,0 +1,83 @@
+#ifndef COUNTINGSEMIJOINOPERATOR_H_
+#define COUNTINGSEMIJOINOPERATOR_H_
+
+#include "Operator.h"
+#include "Relation.h"
+
+
+// join on column with non-unique elements and relation is not used afterwards, using precalculated MultiArrayTable or MultiHashTable
+// instead of passing each join partner, the tuple is passed once with the number of partners as multiplicity,
+// projection multiplies its sums with it
+template<class HT>
+class CountingSemiJoinOperator final : public Operator{
+private:
+	const column_t &probeColumn;
+	const HT *hashtable;
+	// column the table was built on, keys are encoded like the column
+	const column_t &buildColumn;
+	unsigned probeRelation;
+	ColumnParams probeSlots, buildSlots;
+	size_t tableSlot=0;
+
+	template<class Fn>
+	void codegen_impl(Fn &fn, CodegenContext<Fn> &ctx){
+		// fetch value from probed column
+		const ParamBlock &params = ctx.params;
+		auto val = loadValue(fn, params, probeColumn, probeSlots, ctx.rowids[probeRelation]);
+		auto key = encodeKey(fn, params, buildColumn, buildSlots, val);
+		// embed pointer to copy of the table header in the parameter block
+		auto ht = fn.embedValue(params.get<HT>(tableSlot), "hashtable");
+		ht.count(key, [&](auto &count){
+			// multiplicities of several counting semijoins multiply
+			coat::Value<typename Fn::F,uint64_t> multiplicity(fn, "multiplicity");
+			multiplicity = count;
+			auto *outer = ctx.multiplicity;
+			if(outer){
+				multiplicity *= *outer;
+			}
+			ctx.multiplicity = &multiplicity;
+			next->codegen(fn, ctx);
+			ctx.multiplicity = outer;
+		});
+	}
+
+public:
+	CountingSemiJoinOperator(
+		const Relation &relation,
+		const Selection &probeSide,
+		const HT *hashtable,
+		const column_t &buildColumn
+	)
+		: probeColumn(relation.getColumn(probeSide.columnId))
+		, hashtable(hashtable)
+		, buildColumn(buildColumn)
+		, probeRelation(probeSide.relationId)
+	{}
+
+	void execute(Context *ctx) override{
+		uint64_t val = encodeKey(buildColumn, loadValue(probeColumn, ctx->rowids[probeRelation]));
+		auto [itpos,itend] = hashtable->lookupIterators(val);
+		// outside of domain both are nullptr, no partners
+		if(itpos != itend){
+			const uint64_t outer = ctx->multiplicity;
+			ctx->multiplicity = outer * (itend - itpos);
+			next->execute(ctx);
+			ctx->multiplicity = outer;
+		}
+	}
+
+	void bind(ParamBlock &params, std::string &key) override{
+		appendKey(key, 'C', typeTag<HT>());
+		appendKey(key, 'p', probeRelation);
+		probeSlots = bindColumn(params, key, probeColumn);
+		buildSlots = bindColumn(params, key, buildColumn);
+		// header of the table is copied, its arrays stay in place
+		tableSlot = params.bind(*hashtable);
+		next->bind(params, key);
+	}
+
+	void codegen(Fn_asmjit &fn, CodegenContext<Fn_asmjit> &ctx) override { codegen_impl(fn, ctx); }
+	void codegen(Fn_llvmjit &fn, CodegenContext<Fn_llvmjit> &ctx) override { codegen_impl(fn, ctx); }
+};
+
+#endif
@@ -12,26 +12,116 @@ private:
 	uint64_t constant;
 	unsigned relid;
 	Filter::Comparison comparison;
+	// result of comparison might be known for all tuples after translating the constant
+	enum class Mode { Compare, Always, Never } mode = Mode::Compare;
+	ColumnParams columnSlots;
+	size_t constantSlot=0;
+
+	// translate constant to encoded domain of column, comparisons then work on encoded values
+	void translateConstant(){
+		if(column.dictionary){
+			const uint64_t *dict = column.dictionary, *dict_end = column.dictionary + column.dictionary_size;
+			switch(comparison){
+				case Filter::Comparison::Less: {
+					// val < c  <=>  code < first code not less than c
+					uint64_t code = std::lower_bound(dict, dict_end, constant) - dict;
+					if(code == 0) mode = Mode::Never;
+					constant = code;
+					break;
+				}
+				case Filter::Comparison::Greater: {
+					// val > c  <=>  code > last code not greater than c
+					uint64_t code = std::upper_bound(dict, dict_end, constant) - dict;
+					if(code == 0) mode = Mode::Always;
+					else if(code == column.dictionary_size) mode = Mode::Never;
+					constant = code - 1;
+					break;
+				}
+				case Filter::Comparison::Equal: {
+					constant = dictionaryCode(dict, column.dictionary_size, constant);
+					if(constant == column.dictionary_size) mode = Mode::Never;
+					break;
+				}
+			}
+		}else if(column.base != 0){
+			// frame of reference, all values are >= base
+			if(constant < column.base){
+				mode = comparison == Filter::Comparison::Greater ? Mode::Always : Mode::Never;
+			}else if(constant == column.base && comparison == Filter::Comparison::Less){
+				mode = Mode::Never;
+			}
+			constant -= column.base;
+		}
+	}
+
+	// passing[n] = rows[i] for each row passing, branch-free, passing may alias rows
+	template<typename R, typename L>
+	uint64_t compareRows(const R &rows, uint64_t count, uint64_t *passing, L &&load) const{
+		uint64_t n=0;
+		switch(comparison){
+			case Filter::Comparison::Less:
+				for(uint64_t i=0; i<count; ++i){ const uint64_t row = rows[i]; passing[n] = row; n += load(row) < constant; }
+				break;
+			case Filter::Comparison::Greater:
+				for(uint64_t i=0; i<count; ++i){ const uint64_t row = rows[i]; passing[n] = row; n += load(row) > constant; }
+				break;
+			case Filter::Comparison::Equal:
+				for(uint64_t i=0; i<count; ++i){ const uint64_t row = rows[i]; passing[n] = row; n += load(row) == constant; }
+				break;
+		}
+		return n;
+	}
+	// dispatch on column type once per batch instead of once per tuple
+	template<typename R>
+	uint64_t filterRows(const R &rows, uint64_t count, uint64_t *passing) const{
+		if(mode == Mode::Never) return 0;
+		if(mode == Mode::Always){
+			for(uint64_t i=0; i<count; ++i) passing[i] = rows[i];
+			return count;
+		}
+		switch(column.data.index()){
+			case 0: { const uint64_t *v = std::get<uint64_t*>(column.data); return compareRows(rows, count, passing, [v](uint64_t row){ return v[row]; }); }
+			case 1: { const uint32_t *v = std::get<uint32_t*>(column.data); return compareRows(rows, count, passing, [v](uint64_t row){ return v[row]; }); }
+			case 2: { const uint16_t *v = std::get<uint16_t*>(column.data); return compareRows(rows, count, passing, [v](uint64_t row){ return v[row]; }); }
+			case 3: { const uint8_t  *v = std::get<uint8_t *>(column.data); return compareRows(rows, count, passing, [v](uint64_t row){ return v[row]; }); }
+			default: return compareRows(rows, count, passing, [this](uint64_t row){ return loadEncoded(column, row); });
+		}
+	}
+	// rows [begin, begin+count) without materializing them
+	struct RowRange{
+		uint64_t begin;
+		uint64_t operator[](uint64_t i) const { return begin + i; }
+	};
 
 	template<class Fn>
 	void codegen_impl(Fn &fn, CodegenContext<Fn> &ctx){
-		// read from column, depends on column type
-		auto val = loadValue(fn, column, ctx.rowids[relid]);
+		if(mode == Mode::Never){
+			// no tuple passes, omit rest of pipeline
+			return;
+		}
+		if(mode == Mode::Always){
+			next->codegen(fn, ctx);
+			return;
+		}
+		// read encoded value from column, depends on column type
+		auto val = loadEncoded(fn, ctx.params, column, columnSlots, ctx.rowids[relid]);
+		// constant is a parameter, same code for all constants
+		auto vr_constant = loadParam<uint64_t>(fn, ctx.params, constantSlot, "constant");
 		switch(comparison){
 			case Filter::Comparison::Less: {
-				coat::if_then(fn, val < constant, [&]{
+				coat::if_then(fn, val < vr_constant, [&]{
 					next->codegen(fn, ctx);
 				});
 				break;
 			}
 			case Filter::Comparison::Greater: {
-				coat::if_then(fn, val > constant, [&]{
+				coat::if_then(fn, val > vr_constant, [&]{
 					next->codegen(fn, ctx);
 				});
 				break;
 			}
 			case Filter::Comparison::Equal: {
-				coat::if_then(fn, val == constant, [&]{
+				coat::if_then(fn, val == vr_constant, [&]{
 					next->codegen(fn, ctx);
 				});
 				break;
@@ -45,10 +135,18 @@ public:
 		, constant(filter.constant)
 		, relid(filter.sel.relationId)
 		, comparison(filter.comparison)
-	{}
+	{
+		translateConstant();
+	}
 
 	void execute(Context *ctx) override{
-		uint64_t val = loadValue(column, ctx->rowids[relid]);
+		if(mode != Mode::Compare){
+			if(mode == Mode::Always){
+				next->execute(ctx);
+			}
+			return;
+		}
+		uint64_t val = loadEncoded(column, ctx->rowids[relid]);
 		switch(comparison){
 			case Filter::Comparison::Less: {
 				if(val < constant){
@@ -71,6 +169,28 @@ public:
 		}
 	}
 
+	// build pipelines run without code generation, they filter a whole morsel at a time
+	// rows of [begin, end) passing the filter are written to passing, returns their number
+	uint64_t selectMorsel(uint64_t begin, uint64_t end, uint64_t *passing) const{
+		return filterRows(RowRange{begin}, end - begin, passing);
+	}
+	// keeps the rows passing the filter, in place
+	uint64_t selectRows(uint64_t *rows, uint64_t count) const{
+		return filterRows<const uint64_t*>(rows, count, rows);
+	}
+
+	void bind(ParamBlock &params, std::string &key) override{
+		appendKey(key, 'F', relid);
+		key += char(comparison);
+		appendKey(key, 'm', int(mode));
+		if(mode == Mode::Compare){
+			columnSlots = bindColumn(params, key, column);
+			constantSlot = params.bind(constant);
+		}
+		// also if no tuple passes, the projection decides the number of results in the key
+		next->bind(params, key);
+	}
+
 	void codegen(Fn_asmjit &fn, CodegenContext<Fn_asmjit> &ctx) override { codegen_impl(fn, ctx); }
 	void codegen(Fn_llvmjit &fn, CodegenContext<Fn_llvmjit> &ctx) override { codegen_impl(fn, ctx); }
 };
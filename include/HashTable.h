@@ -0,0 +1,334 @@
+#ifndef HASHTABLE_H_
+#define HASHTABLE_H_
+
+#include <cstring> // memset
+#include <limits>
+#include <utility>
+
+#include <coat/Struct.h>
+
+#include "Memory.h"
+#include "RowIds.h"
+
+
+// open addressing with linear probing, for key domains too sparse for ArrayTable/MultiArrayTable/BitsetTable
+// key and payload are stored next to each other in a slot, a probe usually touches a single cache line
+
+// fibonacci hashing, upper bits of the product select the slot
+constexpr uint64_t hash_multiplier = 0x9E3779B97F4A7C15ULL;
+
+// number of slots for the given number of keys, power of two and at most half full
+inline uint64_t hashCapacity(uint64_t keys){
+	uint64_t capacity = 2;
+	while(capacity < 2*keys) capacity <<= 1;
+	return capacity;
+}
+inline uint64_t hashShift(uint64_t capacity){
+	return 64 - __builtin_ctzll(capacity);
+}
+
+
+// unique keys, slot: key, row
+// also used as set of distinct keys, insert() keeps the first row of a key
+template<typename T>
+class HashTable final {
+
+#define MEMBERS(x) \
+	x(T*, slots) \
+	x(T, mask) \
+	x(T, shift)
+
+DECLARE_PRIVATE(MEMBERS)
+#undef MEMBERS
+
+	// memory is not released when mapped from index cache
+	bool owned=true;
+
+	T position(T key) const {
+		return (key * hash_multiplier) >> shift;
+	}
+
+public:
+	explicit HashTable(T capacity)
+		: slots((T*)allocateMemory(2 * capacity * sizeof(T))), mask(capacity - 1), shift(hashShift(capacity))
+	{
+		// row end() marks empty slot
+		memset(slots, 0xff, 2 * capacity * sizeof(T));
+	}
+	template<typename C>
+	HashTable(const C &col, size_t size) : HashTable(col, size, AllRows{}) {}
+	// only some rows, key of row rowids[i] is col[i]
+	template<typename C, typename R>
+	HashTable(const C &col, size_t size, const R &rowids) : HashTable(hashCapacity(size)) {
+		for(size_t i=0; i<size; ++i){
+			insert(col[i], rowids[i]);
+		}
+	}
+	// wrap existing slots, e.g., mapped from the index cache
+	HashTable(T *slots, T capacity) : slots(slots), mask(capacity - 1), shift(hashShift(capacity)), owned(false) {}
+	~HashTable(){
+		if(owned) freeMemory(slots, getSlotsSize() * sizeof(T));
+	}
+
+	// returns false if key is already contained
+	bool insert(T key, T row){
+		for(T pos=position(key); ; pos=(pos + 1) & mask){
+			T *slot = slots + 2*pos;
+			if(slot[1] == end()){
+				slot[0] = key;
+				slot[1] = row;
+				return true;
+			}
+			if(slot[0] == key){
+				return false;
+			}
+		}
+	}
+
+	T lookup(T key) const {
+		for(T pos=position(key); ; pos=(pos + 1) & mask){
+			const T *slot = slots + 2*pos;
+			if(slot[1] == end() || slot[0] == key){
+				return slot[1];
+			}
+		}
+	}
+	bool check(T key) const {
+		return lookup(key) != end();
+	}
+	// rehash into more slots, keeps contained keys
+	void grow(T capacity){
+		HashTable larger(capacity);
+		for(T pos=0; pos<getCapacity(); ++pos){
+			const T *slot = slots + 2*pos;
+			if(slot[1] != end()){
+				larger.insert(slot[0], slot[1]);
+			}
+		}
+		std::swap(slots, larger.slots);
+		std::swap(mask, larger.mask);
+		std::swap(shift, larger.shift);
+		std::swap(owned, larger.owned);
+	}
+	constexpr T end() const {
+		return std::numeric_limits<T>::max();
+	}
+
+	T getCapacity() const { return mask + 1; }
+	const T *getSlots() const { return slots; }
+	size_t getSlotsSize() const { return 2 * getCapacity(); }
+};
+
+
+// non-unique keys, slot: key, begin, end of the rows of the key
+template<typename T>
+class MultiHashTable final {
+
+#define MEMBERS(x) \
+	x(T*, slots) \
+	x(T*, rows) \
+	x(T, mask) \
+	x(T, shift)
+
+DECLARE_PRIVATE(MEMBERS)
+#undef MEMBERS
+
+	// memory is not released when mapped from index cache
+	bool owned=true;
+	size_t rowsSize;
+
+	// slot of key, or empty slot where it belongs
+	T *find(T key) const {
+		for(T pos=(key * hash_multiplier) >> shift; ; pos=(pos + 1) & mask){
+			T *slot = slots + 3*pos;
+			// empty slot has end == 0, each contained key has at least one row
+			if(slot[2] == 0 || slot[0] == key){
+				return slot;
+			}
+		}
+	}
+
+public:
+	template<typename C>
+	MultiHashTable(const C &col, size_t size) : MultiHashTable(col, size, AllRows{}) {}
+	// only some rows, key of row rowids[i] is col[i]
+	template<typename C, typename R>
+	MultiHashTable(const C &col, size_t size, const R &rowids) : rowsSize(size) {
+		const T capacity = hashCapacity(size);
+		mask = capacity - 1;
+		shift = hashShift(capacity);
+		slots = (T*)allocateMemory(3 * capacity * sizeof(T), true);
+		// frequency of keys, stored in end
+		for(size_t i=0; i<size; ++i){
+			T *slot = find(col[i]);
+			slot[0] = col[i];
+			++slot[2];
+		}
+		// prefix sum in slot order, set begin to end position, so that insertion starts at end
+		T prefixSum=0;
+		for(T *slot=slots, *slots_end=slots+3*capacity; slot!=slots_end; slot+=3){
+			prefixSum += slot[2];
+			slot[1] = slot[2] = prefixSum;
+		}
+		// fill rows array, leaves begin at first row of key
+		rows = (T*)allocateMemory(size * sizeof(T));
+		for(uint64_t i=0; i<size; ++i){
+			rows[--find(col[i])[1]] = rowids[i];
+		}
+		// empty slots have begin == end, reset to 0 to mark them empty again
+		for(T *slot=slots, *slots_end=slots+3*capacity; slot!=slots_end; slot+=3){
+			if(slot[1] == slot[2]){
+				slot[1] = slot[2] = 0;
+			}
+		}
+	}
+	// wrap existing arrays, e.g., mapped from the index cache
+	MultiHashTable(T *slots, T capacity, T *rows, size_t rowsSize)
+		: slots(slots), rows(rows), mask(capacity - 1), shift(hashShift(capacity)), owned(false), rowsSize(rowsSize) {}
+	~MultiHashTable(){
+		if(owned){
+			freeMemory(rows, getRowsSize() * sizeof(T));
+			freeMemory(slots, getSlotsSize() * sizeof(T));
+		}
+	}
+
+	std::pair<T*,T*> lookupIterators(size_t key) const {
+		const T *slot = find(key);
+		// empty slot has begin == end == 0
+		return {rows + slot[1], rows + slot[2]};
+	}
+
+	T getCapacity() const { return mask + 1; }
+	const T *getSlots() const { return slots; }
+	size_t getSlotsSize() const { return 3 * getCapacity(); }
+	const T *getRows() const { return rows; }
+	size_t getRowsSize() const { return rowsSize; }
+};
+
+
+namespace coat {
+
+// probe sequence with COAT, leaves idx at first field of the slot of key, or of the empty slot
+// width: number of fields per slot; marker: field which is equal to empty for an empty slot
+template<class CC, typename T, class Slots, class Mask, class Shift>
+void hashProbe(
+	CC &cc, Value<CC,size_t> &key,
+	Slots &slots, Mask &mask, Shift &shift,
+	size_t width, size_t marker, T empty,
+	Value<CC,T> &idx, Value<CC,T> &field
+){
+	Value<CC,T> pos(cc, "pos");
+	pos = key;
+	Value<CC,T> multiplier(cc, T(hash_multiplier), "multiplier");
+	pos *= multiplier;
+	pos >>= shift;
+	Value<CC,T> slotkey(cc, "slotkey");
+	Value<CC,T> searching(cc, "searching");
+	do_while(cc, [&]{
+		idx = pos;
+		idx *= width;
+		slotkey = slots[idx];
+		idx += marker;
+		field = slots[idx];
+		idx -= marker;
+		searching = 0;
+		if_then(cc, field != empty, [&]{
+			if_then(cc, slotkey != key, [&]{
+				// collision, try next slot
+				searching = 1;
+				++pos;
+				pos &= mask;
+			});
+		});
+	}, searching != 0);
+}
+
+template<typename T>
+struct has_custom_base<HashTable<T>> : std::true_type {};
+
+template<class CC, typename T>
+struct StructBase<Struct<CC,HashTable<T>>> {
+	using HT = HashTable<T>;
+
+	// sets idx to slot of key, row to its row or end() if not contained
+	void probe(Value<CC,size_t> &key, Value<CC,T> &idx, Value<CC,T> &row){
+		auto &self = static_cast<Struct<CC,HT>&>(*this);
+		//FIXME: accessed each time
+		auto slots = self.template get_value<HT::member_slots>();
+		auto mask = self.template get_value<HT::member_mask>();
+		auto shift = self.template get_value<HT::member_shift>();
+		hashProbe(self.cc, key, slots, mask, shift, 2, 1, std::numeric_limits<T>::max(), idx, row);
+	}
+
+	template<typename Fn>
+	void lookup(Value<CC,size_t> &key, Fn &&then){
+		auto &self = static_cast<Struct<CC,HT>&>(*this);
+		Value<CC,T> idx(self.cc, "idx");
+		Value<CC,T> row(self.cc, "row");
+		probe(key, idx, row);
+		if_then(self.cc, row != std::numeric_limits<T>::max(), [&]{
+			then(row);
+		});
+	}
+
+	template<typename Fn>
+	void check(Value<CC,size_t> &key, Fn &&then){
+		auto &self = static_cast<Struct<CC,HT>&>(*this);
+		Value<CC,T> idx(self.cc, "idx");
+		Value<CC,T> row(self.cc, "row");
+		probe(key, idx, row);
+		if_then(self.cc, row != std::numeric_limits<T>::max(), then);
+	}
+};
+
+template<typename T>
+struct has_custom_base<MultiHashTable<T>> : std::true_type {};
+
+template<class CC, typename T>
+struct StructBase<Struct<CC,MultiHashTable<T>>> {
+	using HT = MultiHashTable<T>;
+
+	template<typename Fn>
+	void iterate(Value<CC,size_t> &key, Fn &&then) {
+		auto &self = static_cast<Struct<CC,HT>&>(*this);
+		//FIXME: accessed each time
+		auto slots = self.template get_value<HT::member_slots>();
+		auto mask = self.template get_value<HT::member_mask>();
+		auto shift = self.template get_value<HT::member_shift>();
+		Value<CC,T> idx(self.cc, "idx");
+		Value<CC,T> end_offsets(self.cc, "end_offsets");
+		hashProbe(self.cc, key, slots, mask, shift, 3, 2, T(0), idx, end_offsets);
+		// empty slot has begin == end == 0, loop does not execute
+		++idx;
+		Value<CC,T> beg_offsets(self.cc, "beg_offsets");
+		beg_offsets = slots[idx];
+		auto rows = self.template get_value<HT::member_rows>();
+		auto beg = rows + beg_offsets;
+		auto end = rows + end_offsets;
+		for_each(self.cc, beg, end, then);
+	}
+
+	// calls then(count) with the number of rows of key, if any
+	template<typename Fn>
+	void count(Value<CC,size_t> &key, Fn &&then) {
+		auto &self = static_cast<Struct<CC,HT>&>(*this);
+		auto slots = self.template get_value<HT::member_slots>();
+		auto mask = self.template get_value<HT::member_mask>();
+		auto shift = self.template get_value<HT::member_shift>();
+		Value<CC,T> idx(self.cc, "idx");
+		Value<CC,T> end_offsets(self.cc, "end_offsets");
+		hashProbe(self.cc, key, slots, mask, shift, 3, 2, T(0), idx, end_offsets);
+		++idx;
+		Value<CC,T> beg_offsets(self.cc, "beg_offsets");
+		beg_offsets = slots[idx];
+		// empty slot has begin == end == 0
+		if_then(self.cc, end_offsets > beg_offsets, [&]{
+			end_offsets -= beg_offsets;
+			then(end_offsets);
+		});
+	}
+};
+
+} // namespace coat
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef INDEXBUILDER_H_
+#define INDEXBUILDER_H_
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+
+#include "Relation.h"
+
+
+// index which is going to be needed by the workload
+struct IndexRequest{
+	const Relation *relation;
+	int column;
+	IndexKind kind;
+};
+
+// builds requested indexes in background threads, in order of the requests
+// queries which need an index before it is built block in Relation::ensureIndex()
+// paused while a query runs, the query uses all cores itself
+class IndexBuilder{
+private:
+	std::vector<IndexRequest> requests;
+	std::atomic<size_t> next{0};
+	std::atomic<size_t> running{0};
+	std::vector<std::thread> workers;
+	// no new build starts while paused, pause() waits for the running ones
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool paused=false;
+	unsigned active=0;
+	// threads per index, cores left over if there are fewer indexes than workers
+	unsigned build_threads=1;
+	std::chrono::high_resolution_clock::time_point t_start, t_finished;
+
+	void work(){
+		index_build_threads = build_threads;
+		for(;;){
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cv.wait(lock, [this]{ return !paused; });
+				++active;
+			}
+			const size_t i = next++;
+			if(i < requests.size()){
+				const IndexRequest &r = requests[i];
+				r.relation->ensureIndex(r.column, r.kind);
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				--active;
+			}
+			cv.notify_all();
+			if(i >= requests.size()) break;
+		}
+		// last worker records the time all requested indexes were available
+		if(--running == 0){
+			t_finished = std::chrono::high_resolution_clock::now();
+		}
+	}
+
+public:
+	IndexBuilder(std::vector<IndexRequest> &&reqs, size_t threads) : requests(std::move(reqs)) {
+		if(threads > requests.size()){
+			// fewer indexes than cores, remaining cores help building each index
+			build_threads = threads / std::max<size_t>(1, requests.size());
+			threads = requests.size();
+		}
+		t_start = t_finished = std::chrono::high_resolution_clock::now();
+		running = threads;
+		for(size_t i=0; i<threads; ++i){
+			workers.emplace_back(&IndexBuilder::work, this);
+		}
+	}
+	~IndexBuilder(){
+		wait();
+	}
+	IndexBuilder(const IndexBuilder&)=delete;
+
+	// before a query runs, returns when no background build is running anymore
+	void pause(){
+		std::unique_lock<std::mutex> lock(mutex);
+		paused = true;
+		cv.wait(lock, [this]{ return active == 0; });
+	}
+	void resume(){
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			paused = false;
+		}
+		cv.notify_all();
+	}
+
+	void wait(){
+		for(auto &t : workers){
+			t.join();
+		}
+		workers.clear();
+	}
+
+	size_t getNumberOfRequests() const {
+		return requests.size();
+	}
+	// time until all requested indexes were built, only valid after wait()
+	double getBuildTime() const {
+		return std::chrono::duration<double, std::micro>(t_finished - t_start).count();
+	}
+};
+
+#endif
@@ -5,22 +5,29 @@
 #include "Relation.h"
 
 
-// join on column with non-unique elements, using precalculated MultiArrayTable
+// join on column with non-unique elements, using precalculated MultiArrayTable or MultiHashTable
+template<class HT>
 class JoinOperator final : public Operator{
 private:
 	const column_t &probeColumn;
-	const HT_t *hashtable;
+	const HT *hashtable;
+	// column the table was built on, keys are encoded like the column
+	const column_t &buildColumn;
 	unsigned probeRelation;
 	unsigned buildRelation;
+	ColumnParams probeSlots, buildSlots;
+	size_t tableSlot=0;
 
 	template<class Fn>
 	void codegen_impl(Fn &fn, CodegenContext<Fn> &ctx){
 		// fetch value from probed column
-		auto val = loadValue(fn, probeColumn, ctx.rowids[probeRelation]);
-		// embed pointer to hashtable in the generated code
-		auto ht = fn.embedValue(hashtable, "hashtable");
+		const ParamBlock &params = ctx.params;
+		auto val = loadValue(fn, params, probeColumn, probeSlots, ctx.rowids[probeRelation]);
+		auto key = encodeKey(fn, params, buildColumn, buildSlots, val);
+		// embed pointer to copy of the table header in the parameter block
+		auto ht = fn.embedValue(params.get<HT>(tableSlot), "hashtable");
 		// iterate over all join partners
-		ht.iterate(val, [&](auto &ele){
+		ht.iterate(key, [&](auto &ele){
 			// set rowid of joined relation
 			ctx.rowids[buildRelation] = ele;
 			next->codegen(fn, ctx);
@@ -32,16 +39,18 @@ public:
 		const Relation &relation,
 		const Selection &probeSide,
 		const Selection &buildSide,
-		const HT_t *hashtable
+		const HT *hashtable,
+		const column_t &buildColumn
 	)
 		: probeColumn(relation.getColumn(probeSide.columnId))
 		, hashtable(hashtable)
+		, buildColumn(buildColumn)
 		, probeRelation(probeSide.relationId)
 		, buildRelation(buildSide.relationId)
 	{}
 
 	void execute(Context *ctx) override{
-		uint64_t val = loadValue(probeColumn, ctx->rowids[probeRelation]);
+		uint64_t val = encodeKey(buildColumn, loadValue(probeColumn, ctx->rowids[probeRelation]));
 		auto [itpos,itend] = hashtable->lookupIterators(val);
 		// if val is outside of domain of hashtable, lookup() returns nullptr -> check
 		if(itpos && itend){
@@ -53,6 +62,17 @@ public:
 		}
 	}
 
+	void bind(ParamBlock &params, std::string &key) override{
+		appendKey(key, 'J', typeTag<HT>());
+		appendKey(key, 'p', probeRelation);
+		appendKey(key, 'b', buildRelation);
+		probeSlots = bindColumn(params, key, probeColumn);
+		buildSlots = bindColumn(params, key, buildColumn);
+		// header of the table is copied, its arrays stay in place
+		tableSlot = params.bind(*hashtable);
+		next->bind(params, key);
+	}
+
 	void codegen(Fn_asmjit &fn, CodegenContext<Fn_asmjit> &ctx) override { codegen_impl(fn, ctx); }
 	void codegen(Fn_llvmjit &fn, CodegenContext<Fn_llvmjit> &ctx) override { codegen_impl(fn, ctx); }
 };
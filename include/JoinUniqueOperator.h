@@ -5,22 +5,29 @@
 #include "Relation.h"
 
 
-// join on column with unique elements, using precalculated ArrayTable
+// join on column with unique elements, using precalculated ArrayTable or HashTable
+template<class HT>
 class JoinUniqueOperator final : public Operator{
 private:
 	const column_t &probeColumn;
-	const HTu_t *hashtable;
+	const HT *hashtable;
+	// column the table was built on, keys are encoded like the column
+	const column_t &buildColumn;
 	unsigned probeRelation;
 	unsigned buildRelation;
+	ColumnParams probeSlots, buildSlots;
+	size_t tableSlot=0;
 
 	template<class Fn>
 	void codegen_impl(Fn &fn, CodegenContext<Fn> &ctx){
 		// fetch value from probed column
-		auto val = loadValue(fn, probeColumn, ctx.rowids[probeRelation]);
-		// embed pointer to hashtable in the generated code
-		auto ht = fn.embedValue(hashtable, "hashtable_unique");
+		const ParamBlock &params = ctx.params;
+		auto val = loadValue(fn, params, probeColumn, probeSlots, ctx.rowids[probeRelation]);
+		auto key = encodeKey(fn, params, buildColumn, buildSlots, val);
+		// embed pointer to copy of the table header in the parameter block
+		auto ht = fn.embedValue(params.get<HT>(tableSlot), "hashtable_unique");
 		// lookup join partner, if there is one
-		ht.lookup(val, [&](auto &ele){
+		ht.lookup(key, [&](auto &ele){
 			// set rowid of joined relation
 			ctx.rowids[buildRelation] = ele;
 			next->codegen(fn, ctx);
@@ -32,16 +39,18 @@ public:
 		const Relation &relation,
 		const Selection &probeSide,
 		const Selection &buildSide,
-		const HTu_t *hashtable
+		const HT *hashtable,
+		const column_t &buildColumn
 	)
 		: probeColumn(relation.getColumn(probeSide.columnId))
 		, hashtable(hashtable)
+		, buildColumn(buildColumn)
 		, probeRelation(probeSide.relationId)
 		, buildRelation(buildSide.relationId)
 	{}
 
 	void execute(Context *ctx) override{
-		uint64_t val = loadValue(probeColumn, ctx->rowids[probeRelation]);
+		uint64_t val = encodeKey(buildColumn, loadValue(probeColumn, ctx->rowids[probeRelation]));
 		auto it = hashtable->lookup(val);
 		if(it != hashtable->end()){
 			// set rowid of joined relation
@@ -50,6 +59,17 @@ public:
 		}
 	}
 
+	void bind(ParamBlock &params, std::string &key) override{
+		appendKey(key, 'U', typeTag<HT>());
+		appendKey(key, 'p', probeRelation);
+		appendKey(key, 'b', buildRelation);
+		probeSlots = bindColumn(params, key, probeColumn);
+		buildSlots = bindColumn(params, key, buildColumn);
+		// header of the table is copied, its arrays stay in place
+		tableSlot = params.bind(*hashtable);
+		next->bind(params, key);
+	}
+
 	void codegen(Fn_asmjit &fn, CodegenContext<Fn_asmjit> &ctx) override { codegen_impl(fn, ctx); }
 	void codegen(Fn_llvmjit &fn, CodegenContext<Fn_llvmjit> &ctx) override { codegen_impl(fn, ctx); }
 };
@@ -0,0 +1,270 @@
+#ifndef MEMORY_H_
+#define MEMORY_H_
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <atomic>
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+
+
+// allocation policy for large columns and indexes, chosen once at startup before anything is allocated
+
+enum class HugePages : char { None, Transparent, Explicit };
+enum class Prefault : char { None, Populate, Parallel };
+
+// placement on NUMA nodes, partition places sequentially accessed memory (columns) in contiguous chunks
+// across the nodes and interleaves randomly accessed memory (indexes)
+enum class NumaPolicy : char { None, Interleave, Partition };
+enum class Access : char { Random, Sequential };
+
+inline HugePages hugepage_policy = HugePages::None;
+inline Prefault prefault_policy = Prefault::None;
+inline NumaPolicy numa_policy = NumaPolicy::None;
+
+constexpr size_t hugepage_size = 2 * 1024 * 1024;
+// smaller allocations go through malloc, huge pages would waste most of the memory
+constexpr size_t large_allocation = hugepage_size / 2;
+
+inline const char *toString(HugePages p){
+	switch(p){
+		case HugePages::None:        return "none";
+		case HugePages::Transparent: return "thp";
+		case HugePages::Explicit:    return "explicit";
+	}
+	return "unknown";
+}
+inline const char *toString(Prefault p){
+	switch(p){
+		case Prefault::None:     return "none";
+		case Prefault::Populate: return "populate";
+		case Prefault::Parallel: return "parallel";
+	}
+	return "unknown";
+}
+
+inline const char *toString(NumaPolicy p){
+	switch(p){
+		case NumaPolicy::None:       return "none";
+		case NumaPolicy::Interleave: return "interleave";
+		case NumaPolicy::Partition:  return "partition";
+	}
+	return "unknown";
+}
+
+constexpr unsigned max_numa_nodes = 64;
+
+// number of NUMA nodes, 1 if not available
+inline unsigned numaNodes(){
+	static const unsigned nodes = []{
+		unsigned last = 0;
+		// e.g. "0-1" or "0"
+		if(FILE *fd = fopen("/sys/devices/system/node/online", "r")){
+			unsigned first;
+			if(fscanf(fd, "%u-%u", &first, &last) < 1){
+				last = 0;
+			}
+			fclose(fd);
+		}
+		return last < max_numa_nodes ? last + 1 : max_numa_nodes;
+	}();
+	return nodes;
+}
+
+// node the calling thread is running on
+inline unsigned currentNumaNode(){
+	unsigned cpu, node;
+	if(syscall(SYS_getcpu, &cpu, &node, nullptr) != 0 || node >= numaNodes()){
+		return 0;
+	}
+	return node;
+}
+
+// first unit of node's part when count units are split into contiguous parts, rounded down to granule
+// placeMemory() splits bytes at huge pages, the morsel dispatcher splits morsels, both in proportion to the node number
+inline size_t partitionBegin(unsigned node, unsigned nodes, size_t count, size_t granule=1){
+	if(node >= nodes) return count;
+	return (node * count / nodes) / granule * granule;
+}
+
+// binds the calling thread to the cores of node, returns false if they are unknown
+inline bool pinToNode(unsigned node){
+	char fname[64];
+	snprintf(fname, sizeof(fname), "/sys/devices/system/node/node%u/cpulist", node);
+	FILE *fd = fopen(fname, "r");
+	if(!fd) return false;
+	// e.g. "0-7,16-23"
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	unsigned first, last;
+	int n;
+	while((n = fscanf(fd, "%u-%u", &first, &last)) >= 1){
+		if(n == 1) last = first;
+		for(unsigned cpu=first; cpu<=last && cpu<CPU_SETSIZE; ++cpu){
+			CPU_SET(cpu, &cpus);
+		}
+		if(fgetc(fd) != ',') break;
+	}
+	fclose(fd);
+	return CPU_COUNT(&cpus) > 0 && sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+}
+
+// each node prefers one contiguous part of [addr, addr+bytes), in the split of partitionBegin()
+// part boundaries are rounded down to granule, addr does not need to be aligned
+inline void partitionPages(const void *addr, size_t bytes, size_t granule, unsigned flags){
+	const unsigned nodes = numaNodes();
+	const uintptr_t start = (uintptr_t)addr;
+	for(unsigned node=0; node<nodes; ++node){
+		unsigned long mask = 1UL << node;
+		const uintptr_t begin = (start + partitionBegin(node, nodes, bytes)) / granule * granule;
+		const uintptr_t end = node + 1 == nodes
+			? (start + bytes + granule - 1) / granule * granule
+			: (start + partitionBegin(node + 1, nodes, bytes)) / granule * granule;
+		if(begin >= end) continue;
+		syscall(SYS_mbind, begin, end - begin, MPOL_PREFERRED, &mask, max_numa_nodes, flags);
+	}
+}
+
+// memory policy for pages of [addr, addr+bytes), before they are touched
+inline void placeMemory(void *addr, size_t bytes, Access access){
+	const unsigned nodes = numaNodes();
+	if(numa_policy == NumaPolicy::None || nodes < 2) return;
+	if(numa_policy == NumaPolicy::Partition && access == Access::Sequential){
+		// equal contiguous chunks, morsel dispatcher uses the same split
+		partitionPages(addr, bytes, hugepage_size, 0);
+	}else{
+		unsigned long mask = (nodes < 64 ? (1UL << nodes) : 0) - 1;
+		syscall(SYS_mbind, addr, bytes, MPOL_INTERLEAVE, &mask, max_numa_nodes, 0);
+	}
+}
+
+// placement of a column read directly from a file mapping, relation file or index cache
+// page cache pages stay where they were first read, they are faulted in and moved to their nodes
+inline void placeMapping(const void *addr, size_t bytes){
+	const unsigned nodes = numaNodes();
+	if(numa_policy == NumaPolicy::None || nodes < 2 || bytes == 0) return;
+	const size_t pagesize = sysconf(_SC_PAGESIZE);
+	const volatile char *pos = (const volatile char*)addr;
+	for(size_t offset=0; offset<bytes; offset+=pagesize){
+		(void)pos[offset];
+	}
+	(void)pos[bytes - 1];
+	if(numa_policy == NumaPolicy::Partition){
+		partitionPages(addr, bytes, pagesize, MPOL_MF_MOVE);
+	}else{
+		unsigned long mask = (nodes < 64 ? (1UL << nodes) : 0) - 1;
+		const uintptr_t begin = (uintptr_t)addr / pagesize * pagesize;
+		const uintptr_t end = ((uintptr_t)addr + bytes + pagesize - 1) / pagesize * pagesize;
+		syscall(SYS_mbind, begin, end - begin, MPOL_INTERLEAVE, &mask, max_numa_nodes, MPOL_MF_MOVE);
+	}
+}
+
+// node holding the page of each address, where the kernel actually placed it, 0 if unknown
+inline void pageNodes(const void **pages, size_t count, int *nodes){
+	if(syscall(SYS_move_pages, 0, count, pages, nullptr, nodes, 0) != 0){
+		memset(nodes, 0, count * sizeof(int));
+		return;
+	}
+	for(size_t i=0; i<count; ++i){
+		// not mapped yet or error
+		if(nodes[i] < 0) nodes[i] = 0;
+	}
+}
+
+inline size_t roundToHugepage(size_t bytes){
+	return (bytes + hugepage_size - 1) & ~(hugepage_size - 1);
+}
+
+// returns zeroed memory if zero is set, large allocations are always zeroed
+// access pattern decides NUMA placement of large allocations
+inline void *allocateMemory(size_t bytes, bool zero=false, Access access=Access::Random){
+	if(bytes < large_allocation){
+		void *ptr = zero ? calloc(bytes, 1) : malloc(bytes);
+		if(!ptr){
+			perror("failed to allocate memory");
+			exit(EXIT_FAILURE);
+		}
+		return ptr;
+	}
+	const size_t size = roundToHugepage(bytes);
+	if(hugepage_policy == HugePages::Explicit){
+		void *ptr = mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+		if(ptr != MAP_FAILED){
+			placeMemory(ptr, size, access);
+			return ptr;
+		}
+		// not enough huge pages reserved in /proc/sys/vm/nr_hugepages
+		static bool warned = false;
+		if(!warned){
+			warned = true;
+			perror("failed to allocate explicit huge pages, falling back to transparent huge pages");
+		}
+	}
+	// over-allocate to align to huge page boundary, khugepaged only collapses aligned regions
+	char *ptr = (char*)mmap(nullptr, size + hugepage_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(ptr == MAP_FAILED){
+		perror("failed to allocate memory");
+		exit(EXIT_FAILURE);
+	}
+	char *aligned = (char*)(((uintptr_t)ptr + hugepage_size - 1) & ~(hugepage_size - 1));
+	// return unused memory before and after aligned region
+	if(aligned != ptr){
+		munmap(ptr, aligned - ptr);
+	}
+	munmap(aligned + size, hugepage_size - (aligned - ptr));
+	if(hugepage_policy != HugePages::None){
+		madvise(aligned, size, MADV_HUGEPAGE);
+	}
+	placeMemory(aligned, size, access);
+	return aligned;
+}
+
+// bytes has to be the same as in allocation
+inline void freeMemory(void *ptr, size_t bytes){
+	if(!ptr) return;
+	if(bytes < large_allocation){
+		free(ptr);
+	}else{
+		munmap(ptr, roundToHugepage(bytes));
+	}
+}
+
+// budget for narrowed columns and indexes, 0 means unlimited
+inline uint64_t memory_budget = 0;
+inline std::atomic<uint64_t> memory_used{0};
+
+// account bytes against the budget, returns false if they do not fit
+inline bool reserveMemory(uint64_t bytes){
+	uint64_t used = memory_used.load(std::memory_order_relaxed);
+	do{
+		if(memory_budget && used + bytes > memory_budget){
+			return false;
+		}
+	}while(!memory_used.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+	return true;
+}
+inline void releaseMemory(uint64_t bytes){
+	memory_used.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+// fault in all pages of a file mapping ahead of the first scan
+inline void prefaultMapping(void *addr, size_t bytes){
+	if(prefault_policy != Prefault::Parallel) return;
+	madvise(addr, bytes, MADV_WILLNEED);
+	const size_t pagesize = sysconf(_SC_PAGESIZE);
+	const volatile char *pos = (const volatile char*)addr;
+	#pragma omp parallel for schedule(static)
+	for(size_t offset=0; offset<bytes; offset+=pagesize){
+		// touch one byte per page
+		(void)pos[offset];
+	}
+}
+
+#endif
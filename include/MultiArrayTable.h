@@ -1,8 +1,15 @@
 #ifndef MULTIARRAYTABLE_H_
 #define MULTIARRAYTABLE_H_
 
+#include <vector>
+#include <algorithm>
+
+#include <omp.h>
 #include <coat/Struct.h>
 
+#include "Memory.h"
+#include "RowIds.h"
+
 
 template<typename T>
 class MultiArrayTable final {
@@ -16,11 +23,117 @@ class MultiArrayTable final {
 DECLARE_PRIVATE(MEMBERS)
 #undef MEMBERS
 
+	// memory is not released when mapped from index cache
+	bool owned=true;
+
+	// parallel construction: radix partitioning on upper bits of the key, each partition covers a contiguous range of offsets
+	static constexpr unsigned radix_bits = 8;
+	static constexpr unsigned partitions = 1 << radix_bits;
+	// key/row pairs per write-combining buffer, one cache line
+	static constexpr unsigned buffer_pairs = 64 / (2 * sizeof(T));
+	// below this size, threads cost more than they save
+	static constexpr size_t parallel_min_size = 1 << 16;
+
+	// same layout as sequential construction: rows of a key in descending order
+	template<typename C, typename R>
+	void buildParallel(const C &col, const R &rowids, size_t size, unsigned threads){
+		const T domain = max - min + 1;
+		unsigned shift = 0;
+		while(((domain - 1) >> shift) >= partitions) ++shift;
+		// normalized key and row, grouped by partition, ascending rows within partition
+		T *pairs = (T*)allocateMemory(2 * size * sizeof(T));
+		// histogram per thread and partition, turned into write position by prefix sum
+		std::vector<T> cursors(threads * partitions, 0);
+		// start of partitions in pairs
+		std::vector<T> starts(partitions + 1);
+		#pragma omp parallel num_threads(threads)
+		{
+			// team might be smaller than requested, e.g., nested in another parallel region
+			const unsigned team = omp_get_num_threads();
+			const unsigned t = omp_get_thread_num();
+			const size_t begin = size * t / team, end = size * (t + 1) / team;
+			T *cursor = cursors.data() + t * partitions;
+			for(size_t i=begin; i<end; ++i){
+				++cursor[(col[i] - min) >> shift];
+			}
+			#pragma omp barrier
+			#pragma omp single
+			{
+				// partition-major, lower threads hold lower rows
+				T prefixSum=0;
+				for(unsigned p=0; p<partitions; ++p){
+					starts[p] = prefixSum;
+					for(unsigned th=0; th<team; ++th){
+						const T count = cursors[th * partitions + p];
+						cursors[th * partitions + p] = prefixSum;
+						prefixSum += count;
+					}
+				}
+				starts[partitions] = prefixSum;
+			}
+			// scatter through buffers, random writes go to memory a cache line at a time
+			alignas(64) T buffers[partitions][2 * buffer_pairs];
+			unsigned fill[partitions] = {};
+			for(size_t i=begin; i<end; ++i){
+				const T key = col[i] - min;
+				const unsigned p = key >> shift;
+				T *buffer = buffers[p];
+				buffer[2*fill[p]] = key;
+				buffer[2*fill[p] + 1] = rowids[i];
+				if(++fill[p] == buffer_pairs){
+					std::copy(buffer, buffer + 2 * buffer_pairs, pairs + 2 * cursor[p]);
+					cursor[p] += buffer_pairs;
+					fill[p] = 0;
+				}
+			}
+			for(unsigned p=0; p<partitions; ++p){
+				std::copy(buffers[p], buffers[p] + 2 * fill[p], pairs + 2 * cursor[p]);
+			}
+			#pragma omp barrier
+			// sequential algorithm on each partition, writes only its own range of offsets and rows
+			#pragma omp for schedule(dynamic,1)
+			for(unsigned p=0; p<partitions; ++p){
+				const T *pbegin = pairs + 2 * starts[p], *pend = pairs + 2 * starts[p + 1];
+				for(const T *pair=pbegin; pair!=pend; pair+=2){
+					++offsets[pair[0]];
+				}
+				const T kbegin = std::min<T>(T(p) << shift, domain);
+				const T kend = p + 1 == partitions ? domain : std::min<T>(T(p + 1) << shift, domain);
+				T prefixSum = starts[p];
+				for(T k=kbegin; k<kend; ++k){
+					prefixSum += offsets[k];
+					offsets[k] = prefixSum;
+				}
+				for(const T *pair=pbegin; pair!=pend; pair+=2){
+					rows[--offsets[pair[0]]] = pair[1];
+				}
+			}
+		}
+		offsets[domain] = size;
+		freeMemory(pairs, 2 * size * sizeof(T));
+	}
+
 public:
-	MultiArrayTable(T min, T max, T *col, size_t size) : min(min), max(max) {
-		// frequency of values
+	// threads > 1 builds in parallel
+	template<typename C>
+	MultiArrayTable(T min, T max, const C &col, size_t size, unsigned threads=1)
+		: MultiArrayTable(min, max, col, size, AllRows{}, threads) {}
+	// only some rows, key of row rowids[i] is col[i]
+	template<typename C, typename R>
+	MultiArrayTable(T min, T max, const C &col, size_t size, const R &rowids, unsigned threads) : min(min), max(max) {
 		size_t offset_size = max - min + 2;
-		offsets = (T*)calloc(offset_size, sizeof(T));
+		offsets = (T*)allocateMemory(offset_size * sizeof(T), true);
+		// small domains have too few partitions to keep threads busy, but are cache-resident anyway
+		// key/row pairs of the parallel build are accounted against the memory budget while they exist,
+		// sequential build if they do not fit
+		const uint64_t scratch = 2 * size * sizeof(T);
+		if(threads > 1 && size >= parallel_min_size && offset_size > partitions && reserveMemory(scratch)){
+			rows = (T*)allocateMemory(size * sizeof(T));
+			buildParallel(col, rowids, size, threads);
+			releaseMemory(scratch);
+			return;
+		}
+		// frequency of values
 		for(size_t i=0; i<size; ++i){
 			++offsets[col[i] - min];
 		}
@@ -32,15 +145,63 @@ public:
 			*pos = prefixSum; // end position
 		}
 		// fill rows array
-		rows = (T*)malloc(size * sizeof(T));
+		rows = (T*)allocateMemory(size * sizeof(T));
 		for(uint64_t i=0; i<size; ++i){
-			//TODO: bottleneck during construction, random access, writing just one entry
-			rows[--offsets[col[i] - min]] = i;
+			// random access, writing just one entry, buildParallel() scatters through buffers instead
+			rows[--offsets[col[i] - min]] = rowids[i];
 		}
 	}
+	// wrap existing arrays, e.g., mapped from the index cache
+	MultiArrayTable(T min, T max, T *offsets, T *rows)
+		: min(min), max(max), offsets(offsets), rows(rows), owned(false) {}
 	~MultiArrayTable(){
-		free(offsets);
-		free(rows);
+		if(owned){
+			freeMemory(rows, getRowsSize() * sizeof(T));
+			freeMemory(offsets, getOffsetsSize() * sizeof(T));
+		}
+	}
+
+	// adds rows [begin, end) of col, domain grows to [newmin, newmax]
+	// same layout as building from scratch: new rows are larger, in front of the old rows of a key
+	template<typename C>
+	void append(T newmin, T newmax, const C &col, size_t begin, size_t end){
+		const size_t offset_size = newmax - newmin + 2;
+		const size_t old_rows = getRowsSize();
+		T *newoffsets = (T*)allocateMemory(offset_size * sizeof(T), true);
+		for(size_t i=begin; i<end; ++i){
+			++newoffsets[col[i] - newmin];
+		}
+		// frequency of old keys, prefix sum to end positions
+		T prefixSum=0;
+		for(size_t k=0; k<offset_size; ++k){
+			const T key = newmin + k;
+			if(k + 1 < offset_size && key >= min && key <= max){
+				newoffsets[k] += offsets[key - min + 1] - offsets[key - min];
+			}
+			prefixSum += newoffsets[k];
+			newoffsets[k] = prefixSum;
+		}
+		T *newrows = (T*)allocateMemory((old_rows + end - begin) * sizeof(T));
+		// old rows at the end of each key's range
+		for(T key=min; key<=max; ++key){
+			const T count = offsets[key - min + 1] - offsets[key - min];
+			T &pos = newoffsets[key - newmin];
+			pos -= count;
+			std::copy(rows + offsets[key - min], rows + offsets[key - min + 1], newrows + pos);
+		}
+		// new rows in front, descending
+		for(size_t i=begin; i<end; ++i){
+			newrows[--newoffsets[col[i] - newmin]] = i;
+		}
+		if(owned){
+			freeMemory(rows, old_rows * sizeof(T));
+			freeMemory(offsets, getOffsetsSize() * sizeof(T));
+		}
+		min = newmin;
+		max = newmax;
+		offsets = newoffsets;
+		rows = newrows;
+		owned = true;
 	}
 
 	std::pair<T*,T*> lookupIterators(size_t key) const {
@@ -50,6 +211,13 @@ public:
 			return {nullptr, nullptr};
 		}
 	}
+
+	T getMin() const { return min; }
+	T getMax() const { return max; }
+	const T *getOffsets() const { return offsets; }
+	size_t getOffsetsSize() const { return max - min + 2; }
+	const T *getRows() const { return rows; }
+	size_t getRowsSize() const { return offsets[max - min + 1]; }
 };
 
 
@@ -83,6 +251,28 @@ struct StructBase<Struct<CC,MultiArrayTable<T>>> {
 			});
 		});
 	}
+
+	// calls then(count) with the number of rows of key, if any
+	template<typename Fn>
+	void count(Value<CC,size_t> &key, Fn &&then) {
+		auto &self = static_cast<Struct<CC,AT>&>(*this);
+		auto min = self.template get_value<AT::member_min>();
+		if_then(self.cc, key >= min, [&]{
+			auto max = self.template get_reference<AT::member_max>();
+			if_then(self.cc, key <= max, [&]{
+				auto nkey = key - min;
+				auto offsets = self.template get_value<AT::member_offsets>();
+				Value<CC,T> beg_offsets(self.cc, "beg_offsets");
+				beg_offsets = offsets[nkey];
+				Value<CC,T> end_offsets(self.cc, "end_offsets");
+				end_offsets = offsets[nkey+1];
+				if_then(self.cc, end_offsets > beg_offsets, [&]{
+					end_offsets -= beg_offsets;
+					then(end_offsets);
+				});
+			});
+		});
+	}
 };
 
 } // namespace coat
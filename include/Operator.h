@@ -2,9 +2,13 @@
 #define OPERATOR_H_
 
 #include <vector>
+#include <string>
+#include <algorithm>
 
 #include <coat/Function.h>
 
+#include "ParamBlock.h"
+
 
 /*
 operators:
@@ -16,6 +20,11 @@ operators:
 		  - JoinUniqueOperator: using ArrayTable      if unique
 		  - SemiJoinOperator:   using BitsetTable     if unique     and not used later
  - "self join": left and right relation are both already joined/scanned, could be the same relation, just filter
+ - CountingSemiJoin: using MultiArrayTable   if non-unique and not used later, only counts join partners
+ - Build: pipeline breaker, collects rowids of a scanned and filtered relation to build a table for a join on it
+
+before code generation, bind() collects the shape of the pipeline as key and its values in a parameter block,
+generated code only depends on the key, queries with the same key share it
 */
 
 // function signature of generated function
@@ -29,6 +38,8 @@ using Fn_llvmjit = coat::Function<coat::runtimellvmjit,codegen_func_type>;
 struct Context{
 	// current rowids in order as relations are defined in query
 	std::vector<uint64_t> rowids;
+	// number of join partners the current tuple stands for, set by counting semijoins
+	uint64_t multiplicity=1;
 
 	Context(size_t size){
 		rowids.resize(size);
@@ -36,17 +47,56 @@ struct Context{
 };
 
 
-inline uint64_t loadValue(const column_t &col, uint64_t idx){
+// load value as stored in column, without undoing frame of reference or dictionary encoding
+inline uint64_t loadEncoded(const column_t &col, uint64_t idx){
 	// load value from column which can have different type sizes
-	switch(col.index()){
-		case 0: return std::get<uint64_t*>(col)[idx];
-		case 1: return std::get<uint32_t*>(col)[idx];
-		case 2: return std::get<uint16_t*>(col)[idx];
+	uint64_t val;
+	switch(col.data.index()){
+		case 0: val = std::get<uint64_t*>(col.data)[idx]; break;
+		case 1: val = std::get<uint32_t*>(col.data)[idx]; break;
+		case 2: val = std::get<uint16_t*>(col.data)[idx]; break;
+		case 3: val = std::get<uint8_t*>(col.data)[idx]; break;
+		case 4: {
+			const bitpacked_t &packed = std::get<bitpacked_t>(col.data);
+			const uint64_t pos = idx * packed.bits;
+			const uint64_t word = pos / 64, shift = pos % 64;
+			// value can span two words, double shift of high word avoids shift by 64 for shift==0
+			val = (packed.words[word] >> shift) | ((packed.words[word+1] << 1) << (63 - shift));
+			val &= (1ULL << packed.bits) - 1;
+			break;
+		}
 
 		default:
-			fprintf(stderr, "unknown type in column_t: %lu\n", col.index());
+			fprintf(stderr, "unknown type in column_t: %lu\n", col.data.index());
 			abort();
 	}
+	return val;
+}
+
+inline uint64_t loadValue(const column_t &col, uint64_t idx){
+	uint64_t val = loadEncoded(col, idx);
+	if(col.dictionary){
+		return col.dictionary[val];
+	}
+	// undo frame of reference encoding
+	return val + col.base;
+}
+
+// code of value in sorted dictionary, dictionary size if not contained
+inline uint64_t dictionaryCode(const uint64_t *dictionary, uint64_t size, uint64_t val){
+	const uint64_t *pos = std::lower_bound(dictionary, dictionary + size, val);
+	if(pos != dictionary + size && *pos == val){
+		return pos - dictionary;
+	}
+	return size;
+}
+
+// indexes of dictionary-encoded columns are built on the codes, translate probed value
+inline uint64_t encodeKey(const column_t &col, uint64_t val){
+	if(col.dictionary){
+		return dictionaryCode(col.dictionary, col.dictionary_size, val);
+	}
+	return val;
 }
 
 
@@ -58,10 +108,15 @@ struct CodegenContext {
 	std::vector<coat::Value<CC,uint64_t>> rowids;
 	std::vector<coat::Value<CC,uint64_t>> results;
 	coat::Value<CC,uint64_t> amount;
+	// number of join partners the current tuple stands for, only set below counting semijoins
+	coat::Value<CC,uint64_t> *multiplicity=nullptr;
+	// values bound by the operators
+	const ParamBlock &params;
 
-	CodegenContext(Fn &fn, size_t numberOfRelations, size_t numberOfProjections)
+	CodegenContext(Fn &fn, const ParamBlock &params, size_t numberOfRelations, size_t numberOfProjections)
 		: arguments(fn.getArguments("lower", "upper", "proj_addr"))
 		, amount(fn, 0UL, "amount")
+		, params(params)
 	{
 		// emplace_back() in a loop to avoid copies
 		rowids.reserve(numberOfRelations);
@@ -76,37 +131,190 @@ struct CodegenContext {
 };
 
 
-// loadValue with COAT
+// unique per type, distinguishes table types in the key without RTTI
+template<typename T>
+uintptr_t typeTag(){
+	static const char tag=0;
+	return reinterpret_cast<uintptr_t>(&tag);
+}
+
+inline void appendKey(std::string &key, char kind, uint64_t value){
+	key += kind;
+	key += std::to_string(value);
+}
+
+// slots of a column in the parameter block
+struct ColumnParams{
+	size_t data=0;
+	size_t base=0;
+	size_t dictionary=0;
+	size_t dictionary_size=0;
+};
+
+// encoding of a column is part of the shape, its pointers and base are parameters
+inline ColumnParams bindColumn(ParamBlock &params, std::string &key, const column_t &col){
+	ColumnParams slots;
+	appendKey(key, 'c', col.data.index());
+	switch(col.data.index()){
+		case 0: slots.data = params.bind(std::get<uint64_t*>(col.data)); break;
+		case 1: slots.data = params.bind(std::get<uint32_t*>(col.data)); break;
+		case 2: slots.data = params.bind(std::get<uint16_t*>(col.data)); break;
+		case 3: slots.data = params.bind(std::get<uint8_t*>(col.data)); break;
+		case 4: {
+			const bitpacked_t &packed = std::get<bitpacked_t>(col.data);
+			// shift and mask depend on the width
+			appendKey(key, 'w', packed.bits);
+			slots.data = params.bind(packed.words);
+			break;
+		}
+
+		default:
+			fprintf(stderr, "unknown type in column_t: %lu\n", col.data.index());
+			abort();
+	}
+	if(col.dictionary){
+		key += 'd';
+		slots.dictionary = params.bind(col.dictionary);
+		slots.dictionary_size = params.bind(col.dictionary_size);
+	}else if(col.base != 0){
+		key += 'b';
+		slots.base = params.bind(col.base);
+	}
+	return slots;
+}
+
+// load value of a slot in the generated code
+template<typename T, class Fn>
+auto loadParam(Fn &fn, const ParamBlock &params, size_t slot, const char *name){
+	auto param = fn.embedValue(params.get<Param<T>>(slot), name);
+	return param.template get_value<Param<T>::member_value>();
+}
+
+// loadEncoded with COAT
 template<class Fn, class CC>
-coat::Value<CC,uint64_t> loadValue(Fn &fn, const column_t &col, coat::Value<CC,uint64_t> &idx){
+coat::Value<CC,uint64_t> loadEncoded(Fn &fn, const ParamBlock &params, const column_t &col, const ColumnParams &slots, coat::Value<CC,uint64_t> &idx){
 	coat::Value<CC, uint64_t> loaded(fn, "loaded");
-	switch(col.index()){
+	switch(col.data.index()){
 		case 0: {
-			auto vr_col = fn.embedValue(std::get<uint64_t*>(col), "col");
+			auto vr_col = loadParam<uint64_t*>(fn, params, slots.data, "col");
 			// fetch 64 bit value from column
 			loaded = vr_col[idx];
 			break;
 		}
 		case 1: {
-			auto vr_col = fn.embedValue(std::get<uint32_t*>(col), "col");
+			auto vr_col = loadParam<uint32_t*>(fn, params, slots.data, "col");
 			// fetch 32 bit value from column and extend to 64 bit
 			loaded.widen(vr_col[idx]);
 			break;
 		}
 		case 2: {
-			auto vr_col = fn.embedValue(std::get<uint16_t*>(col), "col");
+			auto vr_col = loadParam<uint16_t*>(fn, params, slots.data, "col");
 			// fetch 16 bit value from column and extend to 64 bit
 			loaded.widen(vr_col[idx]);
 			break;
 		}
+		case 3: {
+			auto vr_col = loadParam<uint8_t*>(fn, params, slots.data, "col");
+			// fetch 8 bit value from column and extend to 64 bit
+			loaded.widen(vr_col[idx]);
+			break;
+		}
+		case 4: {
+			const bitpacked_t &packed = std::get<bitpacked_t>(col.data);
+			auto vr_words = loadParam<uint64_t*>(fn, params, slots.data, "packed");
+			// extract value from the two words it can span
+			coat::Value<CC,uint64_t> word(fn, "word");
+			word = idx;
+			word *= packed.bits;
+			coat::Value<CC,uint64_t> shift(fn, "shift");
+			shift = word;
+			shift &= 63;
+			word >>= 6;
+			loaded = vr_words[word];
+			loaded >>= shift;
+			coat::Value<CC,uint64_t> high(fn, "high");
+			++word;
+			high = vr_words[word];
+			// double shift avoids shift by 64 for shift==0
+			high <<= 1;
+			coat::Value<CC,uint64_t> highshift(fn, uint64_t(63), "highshift");
+			highshift -= shift;
+			high <<= highshift;
+			loaded |= high;
+			loaded &= (1ULL << packed.bits) - 1;
+			break;
+		}
 
 		default:
-			fprintf(stderr, "unknown type in column_t: %lu\n", col.index());
+			fprintf(stderr, "unknown type in column_t: %lu\n", col.data.index());
 			abort();
 	}
 	return loaded;
 }
 
+// loadValue with COAT
+template<class Fn, class CC>
+coat::Value<CC,uint64_t> loadValue(Fn &fn, const ParamBlock &params, const column_t &col, const ColumnParams &slots, coat::Value<CC,uint64_t> &idx){
+	auto loaded = loadEncoded(fn, params, col, slots, idx);
+	if(col.dictionary){
+		// look up value of code, dictionary is small and stays in cache
+		auto vr_dict = loadParam<uint64_t*>(fn, params, slots.dictionary, "dictionary");
+		coat::Value<CC,uint64_t> decoded(fn, "decoded");
+		decoded = vr_dict[loaded];
+		return decoded;
+	}
+	if(col.base != 0){
+		// undo frame of reference encoding
+		auto base = loadParam<uint64_t>(fn, params, slots.base, "base");
+		loaded += base;
+	}
+	return loaded;
+}
+
+// encodeKey with COAT
+template<class Fn, class CC>
+coat::Value<CC,uint64_t> encodeKey(Fn &fn, const ParamBlock &params, const column_t &col, const ColumnParams &slots, coat::Value<CC,uint64_t> &val){
+	coat::Value<CC,uint64_t> key(fn, "key");
+	if(col.dictionary){
+		// binary search inlined like dictionaryCode(), at most 16 steps, the dictionary stays in cache
+		auto vr_dict = loadParam<uint64_t*>(fn, params, slots.dictionary, "dictionary");
+		auto vr_size = loadParam<uint64_t>(fn, params, slots.dictionary_size, "dictionary_size");
+		// lower bound in [lo, lo+len), halved each step without branching on the data
+		coat::Value<CC,uint64_t> lo(fn, uint64_t(0), "lo");
+		coat::Value<CC,uint64_t> len(fn, "len");
+		len = vr_size;
+		coat::Value<CC,uint64_t> half(fn, "half");
+		coat::Value<CC,uint64_t> mid(fn, "mid");
+		coat::Value<CC,uint64_t> entry(fn, "entry");
+		coat::loop_while(fn, len > 1, [&]{
+			half = len;
+			half >>= 1;
+			mid = lo;
+			mid += half;
+			entry = vr_dict[mid];
+			coat::if_then(fn, entry < val, [&]{
+				lo = mid;
+			});
+			len -= half;
+		});
+		key = lo;
+		entry = vr_dict[key];
+		coat::if_then(fn, entry < val, [&]{
+			++key;
+			coat::if_then(fn, key < vr_size, [&]{
+				entry = vr_dict[key];
+			});
+		});
+		// missing value gets code size, outside of the index domain
+		coat::if_then(fn, entry != val, [&]{
+			key = vr_size;
+		});
+	}else{
+		key = val;
+	}
+	return key;
+}
+
 
 class Operator{
 protected:
@@ -125,6 +333,9 @@ public:
 	// tuple-by-tuple execution
 	virtual void execute(Context*)=0;
 
+	// shape of the rest of the pipeline appended to key, its values bound to params
+	virtual void bind(ParamBlock &params, std::string &key)=0;
+
 	// code generation with coat, for each backend, chosen at runtime
 	virtual void codegen(Fn_asmjit&, CodegenContext<Fn_asmjit>&)=0;
 	virtual void codegen(Fn_llvmjit&, CodegenContext<Fn_llvmjit>&)=0;
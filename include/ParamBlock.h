@@ -0,0 +1,56 @@
+#ifndef PARAMBLOCK_H_
+#define PARAMBLOCK_H_
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <coat/Struct.h>
+
+
+// one value in the parameter block, generated code reads it like a member of a struct
+template<typename T>
+struct Param final {
+
+#define MEMBERS(x) \
+	x(T, value)
+
+DECLARE_PRIVATE(MEMBERS)
+#undef MEMBERS
+};
+
+// values which differ between queries of the same shape: filter constants, column pointers, table headers
+// generated code loads them from their slots instead of embedding them, slots never move,
+// the code of an earlier query of the same shape is reused by binding the new values to the same slots
+class ParamBlock{
+private:
+	std::vector<std::unique_ptr<uint64_t[]>> slots;
+	std::vector<size_t> sizes; // in bytes
+
+public:
+	// copy of value in a new slot, returns slot index
+	// operators bind in a fixed order, same shape results in same slots
+	template<typename T>
+	size_t bind(const T &value){
+		slots.emplace_back(new uint64_t[(sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t)]);
+		sizes.push_back(sizeof(T));
+		memcpy(slots.back().get(), &value, sizeof(T));
+		return slots.size() - 1;
+	}
+
+	// typed address of slot, embedded in the generated code
+	template<typename T>
+	T *get(size_t slot) const {
+		return reinterpret_cast<T*>(slots[slot].get());
+	}
+
+	// values of another query of the same shape, keeps addresses of the slots
+	void assign(const ParamBlock &other){
+		for(size_t s=0; s<slots.size(); ++s){
+			memcpy(slots[s].get(), other.slots[s].get(), sizes[s]);
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef PLANCACHE_H_
+#define PLANCACHE_H_
+
+#include <string>
+#include <unordered_map>
+
+#include "Operator.h"
+#include "ParamBlock.h"
+
+
+// generated code per shape of pipeline, with the parameter block it reads
+// the shape is the key the operators build while binding their values
+class PlanCache{
+private:
+	struct CachedPlan{
+		codegen_func_type fnptr;
+		ParamBlock params;
+	};
+	std::unordered_map<std::string,CachedPlan> plans;
+	// queries reusing generated code of an earlier query, and queries generating code
+	size_t hits=0;
+	size_t misses=0;
+
+public:
+	// function of an earlier query with the same shape, bound to the values of params, nullptr if there is none
+	codegen_func_type lookup(const std::string &key, const ParamBlock &params){
+		auto it = plans.find(key);
+		if(it == plans.end()){
+			++misses;
+			return nullptr;
+		}
+		++hits;
+		it->second.params.assign(params);
+		return it->second.fnptr;
+	}
+
+	// keeps the parameter block alive for later queries, slots do not move
+	void insert(std::string &&key, codegen_func_type fnptr, ParamBlock &params){
+		plans.emplace(std::move(key), CachedPlan{fnptr, std::move(params)});
+	}
+
+	size_t getHits() const { return hits; }
+	size_t getMisses() const { return misses; }
+	size_t getNumberOfShapes() const { return plans.size(); }
+};
+
+#endif
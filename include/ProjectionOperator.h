@@ -14,19 +14,78 @@ private:
 	// number of tuples reached projection, to distinguish sum==0 and NULL because of no tuples
 	uint64_t amount = 0;
 	uint64_t size;
+	// count columns of bindings bound to groups of eager aggregation
+	std::vector<std::pair<const column_t*,unsigned>> aggregates;
+	// slots of projected and count columns
+	std::vector<ColumnParams> projectionSlots;
+	std::vector<ColumnParams> aggregateSlots;
+
+	// position in aggregates, -1 if relation is bound to a row
+	int aggregateOf(unsigned relid) const {
+		for(size_t a=0; a<aggregates.size(); ++a){
+			if(aggregates[a].second == relid) return a;
+		}
+		return -1;
+	}
 
 	template<class Fn>
 	void codegen_impl(Fn &fn, CodegenContext<Fn> &ctx){
+		using CC = typename Fn::F;
+		if(!aggregates.empty()){
+			// number of rows in the bound group of each aggregated relation
+			std::vector<coat::Value<CC,uint64_t>> counts;
+			counts.reserve(aggregates.size());
+			for(size_t a=0; a<aggregates.size(); ++a){
+				auto [column, relid] = aggregates[a];
+				counts.emplace_back(loadValue(fn, ctx.params, *column, aggregateSlots[a], ctx.rowids[relid]));
+			}
+			// tuple stands for the product of all counts, sums of a group already contain its own count
+			auto weight = [&](int skip){
+				coat::Value<CC,uint64_t> w(fn, uint64_t(1), "weight");
+				if(ctx.multiplicity){
+					w = *ctx.multiplicity;
+				}
+				for(size_t a=0; a<counts.size(); ++a){
+					if(int(a) != skip){
+						w *= counts[a];
+					}
+				}
+				return w;
+			};
+			auto total = weight(-1);
+			for(size_t i=0; i<size; ++i){
+				auto [column, relid] = projections[i];
+				auto val = loadValue(fn, ctx.params, *column, projectionSlots[i], ctx.rowids[relid]);
+				const int a = aggregateOf(relid);
+				if(a < 0){
+					val *= total;
+				}else{
+					auto w = weight(a);
+					val *= w;
+				}
+				ctx.results[i] += val;
+			}
+			ctx.amount += total;
+			return;
+		}
 		// iterate over all projected columns
 		for(size_t i=0; i<size; ++i){
 			auto [column, relid] = projections[i];
 			// fetch value from projected column
-			auto val = loadValue(fn, *column, ctx.rowids[relid]);
+			auto val = loadValue(fn, ctx.params, *column, projectionSlots[i], ctx.rowids[relid]);
+			if(ctx.multiplicity){
+				// tuple stands for several join results
+				val *= *ctx.multiplicity;
+			}
 			// add value to implicit sum on the projected column
 			ctx.results[i] += val;
 		}
 		// count number of elements in sum
-		++ctx.amount;
+		if(ctx.multiplicity){
+			ctx.amount += *ctx.multiplicity;
+		}else{
+			++ctx.amount;
+		}
 	}
 
 	template<class Fn>
@@ -56,13 +115,58 @@ public:
 		size = selections.size();
 	}
 
+	// projections of binding read the sums of the bound group, in order of the selections
+	void aggregate(unsigned binding, const Aggregate &agg){
+		size_t k=0;
+		for(auto &[column, relid] : projections){
+			if(relid == binding){
+				column = &agg.sumColumns[k++];
+			}
+		}
+		aggregates.emplace_back(&agg.countColumn, binding);
+	}
+
 	void execute(Context *ctx) override{
+		if(!aggregates.empty()){
+			uint64_t total = ctx->multiplicity;
+			for(auto [column, relid] : aggregates){
+				total *= loadValue(*column, ctx->rowids[relid]);
+			}
+			for(size_t i=0; i<size; ++i){
+				auto [column, relid] = projections[i];
+				uint64_t weight = total;
+				const int a = aggregateOf(relid);
+				if(a >= 0){
+					// sums of a group already contain its own count
+					weight = ctx->multiplicity;
+					for(auto [count, binding] : aggregates){
+						if(binding != relid) weight *= loadValue(*count, ctx->rowids[binding]);
+					}
+				}
+				results[i] += loadValue(*column, ctx->rowids[relid]) * weight;
+			}
+			amount += total;
+			return;
+		}
 		for(size_t i=0; i<size; ++i){
 			auto [column, relid] = projections[i];
 			uint64_t val = loadValue(*column, ctx->rowids[relid]);
-			results[i] += val;
+			results[i] += val * ctx->multiplicity;
+		}
+		amount += ctx->multiplicity;
+	}
+
+	void bind(ParamBlock &params, std::string &key) override{
+		projectionSlots.clear();
+		for(auto [column, relid] : projections){
+			appendKey(key, 'P', relid);
+			projectionSlots.push_back(bindColumn(params, key, *column));
+		}
+		aggregateSlots.clear();
+		for(auto [column, relid] : aggregates){
+			appendKey(key, 'A', relid);
+			aggregateSlots.push_back(bindColumn(params, key, *column));
 		}
-		++amount;
 	}
 
 	void codegen(Fn_asmjit &fn, CodegenContext<Fn_asmjit> &ctx) override { codegen_impl(fn, ctx); }
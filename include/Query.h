@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <vector>
+#include <deque>
 
 #include "Relation.h"
 //#include "RelationalOperators.h"
@@ -50,17 +51,44 @@ struct Filter{
 		: sel(r, c), constant(constant), comparison(cmp) {}
 };
 
+// how a join predicate is evaluated, decided from the column statistics before any table is built
+struct JoinPlan{
+	enum Kind : char { Retry, SelfJoin, Aggregate, Join, SemiJoin };
+	Kind kind=Retry;
+	// relation is scanned and filtered by a build pipeline, the table only holds the passing rows
+	bool filtered=false;
+	// joined relation is used later, otherwise join partners are only counted
+	bool used=false;
+	// columns of the joined relation summed up by the projection
+	std::vector<unsigned> projected;
+};
+
 struct Query{
 	std::vector<unsigned> relationIds;
 	std::vector<Predicate> predicates;
 	std::vector<Filter> filters;
 	std::vector<Selection> selections;
+	// filters or join predicates contradict each other or the column statistics, result is NULL
+	bool empty=false;
+	// indexes built for this query only, because they exceed the memory budget
+	// deque keeps references stable, operators point to them
+	std::deque<hashtable_t> temporaryHTs;
+	std::deque<bitset_t> temporaryBTs;
+	// grouped relations of eager aggregation
+	std::deque<Aggregate> temporaryAggregates;
 
 	void parse(char *line);
 	void rewrite(const std::vector<Relation> &relations);
+	void prune(const std::vector<Relation> &relations);
+	// one step per join predicate, Join probes the hash table of the right column, SemiJoin its bitset
+	std::vector<JoinPlan> plan(const std::vector<Relation> &relations) const;
 	std::pair<ScanOperator*,ProjectionOperator*> constructPipeline(const std::vector<Relation> &relations);
 	void clear();
 };
 
+// build pipeline: scans a relation and applies its filters, in parallel on ranges of morsels
+// returns the rowids of the tuples passing, ascending
+std::vector<uint64_t> runBuildPipeline(const Relation &relation, unsigned binding, const std::vector<Filter> &filters, unsigned threads);
+
 
 #endif
@@ -7,10 +7,17 @@
 #include <vector>
 #include <variant>
 #include <chrono>
+#include <string>
+#include <atomic>
+#include <memory>
 
+#include "Memory.h"
 #include "MultiArrayTable.h"
 #include "ArrayTable.h"
 #include "BitsetTable.h"
+#include "HashTable.h"
+#include "ColumnStatistics.h"
+#include "RelationFormat.h"
 
 
 //FIXME: hardcoded type
@@ -21,18 +28,144 @@ using HT_t = MultiArrayTable<uint64_t>;
 using HTu_t = ArrayTable<uint64_t>;
 
 
-using hashtable_t = std::variant<std::monostate,HT_t,HTu_t>;
-using column_t = std::variant<uint64_t*,uint32_t*,uint16_t*>;
+// sparse key domains
+using HTs_t = MultiHashTable<uint64_t>;
+using HTsu_t = HashTable<uint64_t>;
+
+using hashtable_t = std::variant<std::monostate,HT_t,HTu_t,HTs_t,HTsu_t>;
+// set of keys for semijoins, hash table of distinct keys if domain is sparse
+using bitset_t = std::variant<std::monostate,BitsetTable,HTsu_t>;
+
+// array-based indexes are used as long as the key domain is at most this many times larger than the relation
+constexpr uint64_t max_domain_per_tuple = 16;
+// threads the calling thread uses to precalculate a single column or index
+// set to the cores not used by precalculating several columns at once
+inline thread_local unsigned index_build_threads = 1;
+
+// precalculation phases, time is accumulated over all columns
+enum PrecalcPhase : uint8_t { PHASE_MINMAX, PHASE_SKETCH, PHASE_MINIMIZE, PHASE_BITSET, PHASE_HT, PRECALC_PHASES };
+inline std::atomic<uint64_t> precalc_time_ns[PRECALC_PHASES];
+inline const char *toString(PrecalcPhase p){
+	switch(p){
+		case PHASE_MINMAX: return "minmax";
+		case PHASE_SKETCH: return "sketch";
+		case PHASE_MINIMIZE: return "minimize";
+		case PHASE_BITSET: return "bitset";
+		case PHASE_HT: return "HT";
+		default: return "unknown";
+	}
+}
+// bit-packed column, value i occupies bits [i*bits, (i+1)*bits) of the word array
+struct bitpacked_t{
+	uint64_t *words;
+	uint64_t bits;
+
+	// one word of padding, extraction always loads two consecutive words
+	static uint64_t numberOfWords(uint64_t size, uint64_t bits){
+		return (size*bits + 63) / 64 + 1;
+	}
+};
+
+// column values, minimized to smallest type which fits
+using column_data_t = std::variant<uint64_t*,uint32_t*,uint16_t*,uint8_t*,bitpacked_t>;
+struct column_t{
+	column_data_t data;
+	// frame of reference, stored values are offsets to base
+	uint64_t base=0;
+	// sorted distinct values, stored values are codes (positions in dictionary)
+	uint64_t *dictionary=nullptr;
+	uint64_t dictionary_size=0;
+};
+
+// rows of a relation grouped by join key, for eager aggregation below a join
+// joining the group table binds the relation to a group instead of a row,
+// projection reads the number of rows and the sums of the group like columns
+struct Aggregate{
+	// key to group, HTu_t or HTsu_t
+	hashtable_t groups;
+	std::vector<uint64_t> counts;
+	std::vector<std::vector<uint64_t>> sums;
+	column_t countColumn;
+	std::vector<column_t> sumColumns;
+};
+
+
+// statistics of a column gathered during precalculation
+struct ColumnInfo{
+	uint64_t min;
+	uint64_t max;
+	// number of distinct values, known after the bitset is built
+	uint64_t distinct;
+};
+
+// tuples per morsel, zone maps summarize blocks of the same size
+constexpr uint64_t morsel_size = 1024;
+
+// min and max of a column within one morsel
+struct ZoneMap{
+	uint64_t min;
+	uint64_t max;
+};
+
+// indexes precalculated per column, can be built on demand
+enum IndexKind : uint8_t { INDEX_BT, INDEX_HT, INDEX_KINDS };
 
 
 class Relation{
 private:
+	std::string fname;
 	char *mapped_addr; // address returned by mmap()
 	uint64_t fsize;
 	uint64_t size; // number of tuples
+	// tuples allocated per column, columns are growable copies after append()
+	uint64_t capacity=0;
+	bool appended=false;
+	// append() in progress, no index build may start, guarded by the mutex of the index states
+	mutable bool appending=false;
 	std::vector<column_t> columns;
-	std::vector<BitsetTable> BTs;
-	std::vector<hashtable_t> HTs;
+	// per-column header of version 2 files, nullptr for version 1
+	const RelationColumn *formats=nullptr;
+	// distinct count is filled in by buildBT(), which can run lazily or for a temporary bitset
+	mutable std::vector<ColumnInfo> infos;
+	// per column, one entry per morsel
+	std::vector<ZoneMap*> zonemaps;
+	// histogram, distinct-count sketch and heavy hitters per column
+	std::vector<ColumnStatistics*> statistics;
+	// indexes are built on first use if not precalculated
+	mutable std::vector<bitset_t> BTs;
+	mutable std::vector<hashtable_t> HTs;
+	// build state, usage and memory per column and index kind
+	enum IndexState : uint8_t { INDEX_MISSING, INDEX_BUILDING, INDEX_READY };
+	struct IndexSlot{
+		std::atomic<uint8_t> state{INDEX_MISSING};
+		// number of queries which asked for the index, value when evicting
+		std::atomic<uint64_t> uses{0};
+		// accounted against the memory budget
+		uint64_t bytes=0;
+	};
+	std::unique_ptr<IndexSlot[]> indexes;
+	// index cache mapped into memory, nullptr if precalculated
+	char *cache_addr=nullptr;
+	uint64_t cache_size=0;
+	// NUMA node holding the pages of each morsel per column, as placed by the kernel, empty on a single node
+	std::vector<std::vector<uint8_t>> page_nodes;
+
+	// precalculation phases
+	template<typename F>
+	void withValues(int column, F &&f) const;
+	void minmax(int column);
+	void sketch(int column);
+	// returns true if the values were also inserted into bt, i.e., in the same pass as narrowing
+	bool minimize(int column, BitsetTable *bt=nullptr);
+	template<typename C>
+	bool minimize(int column, const C &col, BitsetTable *bt);
+	void minimizeWithBitset(int column);
+	template<typename F>
+	void withIndexKeys(int column, F &&f) const;
+	// append phases
+	void appendColumn(int column, const uint64_t *tuples, uint64_t count, uint64_t first, uint64_t newcapacity);
+	void appendZones(int column, uint64_t first, bool owned);
+	void appendIndexes(int column, uint64_t first);
 
 public:
 	Relation(const char *fname);
@@ -50,18 +183,105 @@ public:
 		return columns.size();
 	}
 
+	inline const ColumnInfo &getColumnInfo(int col) const{
+		return infos[col];
+	}
+	// true if no value occurs twice in the column, counts distinct values with a temporary bitset if unknown
+	bool isUnique(int col) const;
+
+	inline uint64_t getNumberOfZones() const{
+		return (size + morsel_size - 1) / morsel_size;
+	}
+	inline const ZoneMap *getZoneMap(int col) const{
+		return zonemaps[col];
+	}
+	// ask the kernel where the pages of each morsel are, again after columns were replaced
+	void locatePages();
+	inline unsigned getPageNode(int col, uint64_t morsel) const{
+		return page_nodes.empty() ? 0 : page_nodes[col][morsel];
+	}
+	// bytes read from the column for one morsel
+	uint64_t getMorselBytes(int col, uint64_t morsel) const;
+
+	// on original values, also for dictionary-encoded columns
+	inline const ColumnStatistics &getColumnStatistics(int col) const{
+		return *statistics[col];
+	}
+
+	// key domain of indexes, codes for dictionary-encoded columns
+	inline std::pair<uint64_t,uint64_t> getIndexDomain(int col) const{
+		if(columns[col].dictionary){
+			return {0, columns[col].dictionary_size - 1};
+		}
+		return {infos[col].min, infos[col].max};
+	}
+
+	// key domain too sparse for array-based indexes
+	inline bool isSparse(int col) const{
+		auto [min, max] = getIndexDomain(col);
+		return max - min >= size * max_domain_per_tuple;
+	}
+
+	// original 64-bit column in the relation file, independent of minimization, only in version 1 files before append()
+	inline uint64_t *getRawColumn(int col) const{
+		return reinterpret_cast<uint64_t*>(mapped_addr + 2*sizeof(uint64_t)) + col*size;
+	}
+
 	void stats_init(){
+		infos.resize(getNumberOfColumns());
+		zonemaps.resize(getNumberOfColumns(), nullptr);
+		statistics.resize(getNumberOfColumns(), nullptr);
 		BTs.resize(getNumberOfColumns());
 		HTs.resize(getNumberOfColumns());
+		indexes.reset(new IndexSlot[getNumberOfColumns()*INDEX_KINDS]);
 	}
 	// precalculate column, used in multi-threaded case
 	void stats(int column);
+	// precalculate only statistics and minimized column, indexes are built by ensureIndex()
+	void stats_lazy(int column);
+	// build index if not done yet, blocks while another thread builds it
+	// returns false if the index does not fit into the memory budget
+	bool ensureIndex(int column, IndexKind kind) const;
+	// build index into given table, e.g., a temporary one for a single query
+	void buildBT(int column, bitset_t &bt) const;
+	void buildHT(int column, hashtable_t &ht) const;
+	// build index on the given rows only, ascending, e.g., the rows passing the filters of a build pipeline
+	void buildFilteredBT(int column, const std::vector<uint64_t> &rows, bitset_t &bt, unsigned threads) const;
+	void buildFilteredHT(int column, const std::vector<uint64_t> &rows, hashtable_t &ht, unsigned threads) const;
+	// group rows by key column, with sums of the given columns per group, rows nullptr for all rows
+	void buildAggregate(int column, const std::vector<unsigned> &sumColumns, const std::vector<uint64_t> *rows, Aggregate &agg, unsigned threads) const;
+	uint64_t estimateIndexBytes(int column, IndexKind kind) const;
+
+	// bookkeeping for eviction when a memory budget is set
+	bool isIndexResident(int column, IndexKind kind) const{
+		return indexes[column*INDEX_KINDS + kind].state.load(std::memory_order_acquire) == INDEX_READY;
+	}
+	uint64_t getIndexUses(int column, IndexKind kind) const{
+		return indexes[column*INDEX_KINDS + kind].uses.load(std::memory_order_relaxed);
+	}
+	uint64_t getIndexBytes(int column, IndexKind kind) const{
+		return indexes[column*INDEX_KINDS + kind].bytes;
+	}
+	// release resident index, it is rebuilt on next use; no query may use it at that time
+	void evictIndex(int column, IndexKind kind);
+
+	// add count tuples, given row by row, to columns, statistics and resident indexes
+	// no query may run on the relation at that time, index builds wait until it is done
+	void append(const uint64_t *tuples, uint64_t count);
+
+	// map precalculated columns and indexes from sidecar file, returns false if missing or stale
+	bool loadIndexCache();
+	// write precalculated columns and indexes to sidecar file
+	void storeIndexCache() const;
 
+	// nullptr if the index does not fit into the memory budget, build a temporary one with buildHT()/buildBT()
 	const hashtable_t *getHT(int col) const{
-		return &HTs[col];
+		++indexes[col*INDEX_KINDS + INDEX_HT].uses;
+		return ensureIndex(col, INDEX_HT) ? &HTs[col] : nullptr;
 	}
-	const BitsetTable *getBT(int col) const{
-		return &BTs[col];
+	const bitset_t *getBT(int col) const{
+		++indexes[col*INDEX_KINDS + INDEX_BT].uses;
+		return ensureIndex(col, INDEX_BT) ? &BTs[col] : nullptr;
 	}
 };
 
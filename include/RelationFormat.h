@@ -0,0 +1,46 @@
+#ifndef RELATIONFORMAT_H_
+#define RELATIONFORMAT_H_
+
+#include <cstdint>
+#include <cstring>
+
+
+// relation files, version 1 (contest format):
+//   uint64_t size, uint64_t num_columns, num_columns * size 64-bit values
+// version 2, written by the convert tool:
+//   RelationHeader
+//   RelationColumn[num_columns]
+//   columns, each narrowed to its width and aligned to a cache line
+
+static constexpr char relation_magic[8] = {'S','I','G','1','8','R','E','L'};
+static constexpr uint64_t relation_version = 2;
+static constexpr uint64_t relation_alignment = 64;
+
+enum RelationEncoding : uint64_t {
+	ENCODING_PLAIN,  // values as they are
+	ENCODING_OFFSET, // frame of reference, stored values are offsets to base
+};
+
+struct RelationHeader{
+	char magic[8];
+	uint64_t version;
+	uint64_t size;
+	uint64_t num_columns;
+};
+
+struct RelationColumn{
+	uint64_t width;    // bits per stored value: 8, 16, 32 or 64
+	uint64_t encoding; // RelationEncoding
+	uint64_t base;     // zero for ENCODING_PLAIN
+	uint64_t min;      // of original values, used instead of scanning the column
+	uint64_t max;
+	uint64_t distinct; // equal to the number of tuples for unique columns
+	uint64_t offset;   // of stored values, relative to start of file
+};
+
+// true if the mapped file starts with the header of version 2
+inline bool isRelationV2(const char *addr, uint64_t fsize){
+	return fsize >= sizeof(RelationHeader) && memcmp(addr, relation_magic, sizeof(relation_magic)) == 0;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef ROWIDS_H_
+#define ROWIDS_H_
+
+#include <cstdint>
+#include <cstddef>
+
+
+// row ids stored in tables, entry i of the keys has row rowids[i]
+
+// all rows of a column, row id is the position in the column
+struct AllRows{
+	uint64_t operator[](size_t idx) const{
+		return idx;
+	}
+};
+
+// keys of selected rows only, e.g., rows passing the filters of a build pipeline
+template<typename C>
+struct SelectedKeys{
+	const C &col;
+	const uint64_t *rows;
+
+	uint64_t operator[](size_t idx) const{
+		return col[rows[idx]];
+	}
+};
+
+#endif
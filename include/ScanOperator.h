@@ -2,42 +2,101 @@
 #define SCANOPERATOR_H_
 
 #include "Operator.h"
+#include "Query.h"
+
+#include <algorithm>
 
 #include <coat/ControlFlow.h>
 
 
 class ScanOperator final : public Operator{
 private:
+	const Relation &relation;
 	uint64_t tuples;
+	// binding of the scanned relation in the query
+	unsigned binding;
+	// columns of the scanned relation the pipeline reads, for accounting of memory traffic
+	std::vector<unsigned> columns;
+	// filters on the scanned relation, checked against zone maps to skip whole morsels
+	struct ZoneFilter{
+		const ZoneMap *zones;
+		uint64_t constant;
+		Filter::Comparison comparison;
+	};
+	std::vector<ZoneFilter> zonefilters;
 
 	template<class Fn>
 	void codegen_impl(Fn &fn, CodegenContext<Fn> &ctx){
 		// do not make a copy, just take the virtual register from arguments
-		ctx.rowids[0] = std::move(std::get<0>(ctx.arguments));
+		ctx.rowids[binding] = std::move(std::get<0>(ctx.arguments));
 		auto &upper = std::get<1>(ctx.arguments);
 		coat::do_while(fn, [&]{
 			next->codegen(fn, ctx);
-			++ctx.rowids[0];
-		}, ctx.rowids[0] < upper);
+			++ctx.rowids[binding];
+		}, ctx.rowids[binding] < upper);
 	}
 
 public:
-	ScanOperator(const Relation &relation) : tuples(relation.getNumberOfTuples()) {}
+	ScanOperator(const Relation &relation, unsigned binding=0) : relation(relation), tuples(relation.getNumberOfTuples()), binding(binding) {}
 
 	void execute(Context *ctx) override {
-		for(uint64_t idx=0; idx<tuples; ++idx){
-			// pass tuple by tuple (very bad performance without codegen)
-			ctx->rowids[0] = idx;
-			next->execute(ctx);
+		execute(ctx, 0, getMorsels());
+	}
+	// only morsels [first, last), e.g., of one thread
+	void execute(Context *ctx, uint64_t first, uint64_t last){
+		for(uint64_t m=first; m<last; ++m){
+			if(skipMorsel(m)) continue;
+			const uint64_t end = std::min((m+1)*morsel_size, tuples);
+			for(uint64_t idx=m*morsel_size; idx<end; ++idx){
+				// pass tuple by tuple (very bad performance without codegen)
+				ctx->rowids[binding] = idx;
+				next->execute(ctx);
+			}
 		}
 	}
 
+	void bind(ParamBlock &params, std::string &key) override{
+		appendKey(key, 'S', binding);
+		next->bind(params, key);
+	}
+
 	void codegen(Fn_asmjit &fn, CodegenContext<Fn_asmjit> &ctx) override { codegen_impl(fn, ctx); }
 	void codegen(Fn_llvmjit &fn, CodegenContext<Fn_llvmjit> &ctx) override { codegen_impl(fn, ctx); }
 
 	uint64_t getTuples() const {
 		return tuples;
 	}
+	uint64_t getMorsels() const {
+		return (tuples + morsel_size - 1) / morsel_size;
+	}
+
+	const Relation &getRelation() const {
+		return relation;
+	}
+	void addColumn(unsigned column){
+		if(std::find(columns.begin(), columns.end(), column) == columns.end()){
+			columns.push_back(column);
+		}
+	}
+	const std::vector<unsigned> &getColumns() const {
+		return columns;
+	}
+
+	void addZoneFilter(const ZoneMap *zones, const Filter &filter){
+		zonefilters.push_back({zones, filter.constant, filter.comparison});
+	}
+	// true if zone maps prove that no tuple of the morsel passes the filters
+	bool skipMorsel(uint64_t m) const {
+		for(const ZoneFilter &f : zonefilters){
+			const ZoneMap &zone = f.zones[m];
+			switch(f.comparison){
+				case Filter::Comparison::Less:    if(zone.min >= f.constant) return true; break;
+				case Filter::Comparison::Greater: if(zone.max <= f.constant) return true; break;
+				case Filter::Comparison::Equal:   if(f.constant < zone.min || f.constant > zone.max) return true; break;
+			}
+		}
+		return false;
+	}
 };
 
 #endif
@@ -15,11 +15,12 @@ private:
 	const column_t &rightColumn;
 	unsigned leftBinding;
 	unsigned rightBinding;
+	ColumnParams leftSlots, rightSlots;
 
 	template<class Fn>
 	void codegen_impl(Fn &fn, CodegenContext<Fn> &ctx){
-		auto lval = loadValue(fn, leftColumn, ctx.rowids[leftBinding]);
-		auto rval = loadValue(fn, rightColumn, ctx.rowids[rightBinding]);
+		auto lval = loadValue(fn, ctx.params, leftColumn, leftSlots, ctx.rowids[leftBinding]);
+		auto rval = loadValue(fn, ctx.params, rightColumn, rightSlots, ctx.rowids[rightBinding]);
 		if_then(fn, lval == rval, [&]{
 			next->codegen(fn, ctx);
 		});
@@ -46,6 +47,14 @@ public:
 		}
 	}
 
+	void bind(ParamBlock &params, std::string &key) override{
+		appendKey(key, 'X', leftBinding);
+		appendKey(key, '=', rightBinding);
+		leftSlots = bindColumn(params, key, leftColumn);
+		rightSlots = bindColumn(params, key, rightColumn);
+		next->bind(params, key);
+	}
+
 	void codegen(Fn_asmjit &fn, CodegenContext<Fn_asmjit> &ctx) override { codegen_impl(fn, ctx); }
 	void codegen(Fn_llvmjit &fn, CodegenContext<Fn_llvmjit> &ctx) override { codegen_impl(fn, ctx); }
 };
@@ -6,21 +6,28 @@
 #include "BitsetTable.h"
 
 
-// join on column with unique elements and relation is not used afterwards, using precalculated BitsetTable
+// join on column with unique elements and relation is not used afterwards, using precalculated BitsetTable or HashTable
+template<class BT>
 class SemiJoinOperator final : public Operator{
 private:
 	const column_t &probeColumn;
-	const BitsetTable *hashtable;
+	const BT *hashtable;
+	// column the table was built on, keys are encoded like the column
+	const column_t &buildColumn;
 	unsigned probeRelation;
+	ColumnParams probeSlots, buildSlots;
+	size_t tableSlot=0;
 
 	template<class Fn>
 	void codegen_impl(Fn &fn, CodegenContext<Fn> &ctx){
 		// fetch value from probed column
-		auto val = loadValue(fn, probeColumn, ctx.rowids[probeRelation]);
-		// embed pointer to hashtable in the generated code
-		auto bt = fn.embedValue(hashtable, "bitsettable");
+		const ParamBlock &params = ctx.params;
+		auto val = loadValue(fn, params, probeColumn, probeSlots, ctx.rowids[probeRelation]);
+		auto key = encodeKey(fn, params, buildColumn, buildSlots, val);
+		// embed pointer to copy of the table header in the parameter block
+		auto bt = fn.embedValue(params.get<BT>(tableSlot), "bitsettable");
 		// check for join partner
-		bt.check(val, [&]{
+		bt.check(key, [&]{
 			next->codegen(fn, ctx);
 		});
 	}
@@ -29,20 +36,32 @@ public:
 	SemiJoinOperator(
 		const Relation &relation,
 		const Selection &probeSide,
-		const BitsetTable *hashtable
+		const BT *hashtable,
+		const column_t &buildColumn
 	)
 		: probeColumn(relation.getColumn(probeSide.columnId))
 		, hashtable(hashtable)
+		, buildColumn(buildColumn)
 		, probeRelation(probeSide.relationId)
 	{}
 
 	void execute(Context *ctx) override{
-		uint64_t val = loadValue(probeColumn, ctx->rowids[probeRelation]);
-		if(hashtable->lookup(val)){
+		uint64_t val = encodeKey(buildColumn, loadValue(probeColumn, ctx->rowids[probeRelation]));
+		if(hashtable->check(val)){
 			next->execute(ctx);
 		}
 	}
 
+	void bind(ParamBlock &params, std::string &key) override{
+		appendKey(key, 'H', typeTag<BT>());
+		appendKey(key, 'p', probeRelation);
+		probeSlots = bindColumn(params, key, probeColumn);
+		buildSlots = bindColumn(params, key, buildColumn);
+		// header of the table is copied, its arrays stay in place
+		tableSlot = params.bind(*hashtable);
+		next->bind(params, key);
+	}
+
 	void codegen(Fn_asmjit &fn, CodegenContext<Fn_asmjit> &ctx) override { codegen_impl(fn, ctx); }
 	void codegen(Fn_llvmjit &fn, CodegenContext<Fn_llvmjit> &ctx) override { codegen_impl(fn, ctx); }
 };
@@ -0,0 +1,400 @@
+#include "Relation.h"
+
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+// sidecar file next to the relation file, containing everything precalc() produces
+// layout (all offsets relative to start of file, segments aligned to cache lines):
+//   CacheHeader
+//   CacheColumn[num_columns]
+//   segments: narrowed column, dictionary, zone map, statistics, bitset, hashtable arrays
+
+static constexpr char cache_magic[8] = {'S','I','G','1','8','I','D','X'};
+static constexpr uint64_t cache_version = 9;
+static constexpr uint64_t cache_alignment = 64;
+
+// compile-time options which change the content of the cache
+static constexpr uint64_t cache_options =
+#ifdef MINIMIZECOL
+	1 << 0 |
+#endif
+#ifdef BITPACKCOL
+	1 << 1 |
+#endif
+#ifdef DICTIONARYCOL
+	1 << 2 |
+#endif
+	0;
+
+enum CacheSegment {
+	SEG_COLUMN,     // narrowed column, empty if column is used directly from relation file
+	SEG_DICTIONARY, // values of dictionary-encoded column
+	SEG_ZONEMAP,    // min/max per morsel
+	SEG_STATISTICS, // ColumnStatistics
+	SEG_BITSET,     // data of BitsetTable or slots of HashTable
+	SEG_HT_ARRAY,   // arr of ArrayTable, offsets of MultiArrayTable or slots of hash tables
+	SEG_HT_ROWS,    // rows of MultiArrayTable or MultiHashTable
+	SEG_COUNT
+};
+
+struct CacheHeader{
+	char magic[8];
+	uint64_t version;
+	uint64_t options;
+	uint64_t checksum; // of relation file
+	uint64_t size;
+	uint64_t num_columns;
+};
+
+struct CacheColumn{
+	ColumnInfo info;
+	uint64_t column_type; // index in column_data_t
+	uint64_t column_base; // frame of reference
+	uint64_t column_bits; // only for bit-packed columns
+	uint64_t dictionary_size; // zero if not dictionary-encoded
+	uint64_t bt_type; // index in bitset_t
+	uint64_t ht_type; // index in hashtable_t
+	struct {
+		uint64_t offset;
+		uint64_t bytes;
+	} segments[SEG_COUNT];
+};
+
+
+// position-dependent hash of the relation file, chunks hashed in parallel
+static uint64_t checksum(const char *addr, uint64_t bytes){
+	const uint64_t chunk_size = 1 << 20;
+	const uint64_t chunks = (bytes + chunk_size - 1) / chunk_size;
+	std::vector<uint64_t> hashes(chunks);
+	#pragma omp parallel for schedule(static)
+	for(uint64_t c=0; c<chunks; ++c){
+		const char *pos = addr + c*chunk_size;
+		const uint64_t len = std::min(chunk_size, bytes - c*chunk_size);
+		// FNV-1a on 64-bit words, seeded with chunk number
+		uint64_t h = 0xcbf29ce484222325ULL ^ c;
+		uint64_t i=0;
+		for(; i+sizeof(uint64_t)<=len; i+=sizeof(uint64_t)){
+			uint64_t word;
+			memcpy(&word, pos+i, sizeof(uint64_t));
+			h = (h ^ word) * 0x100000001b3ULL;
+		}
+		for(; i<len; ++i){
+			h = (h ^ (unsigned char)pos[i]) * 0x100000001b3ULL;
+		}
+		hashes[c] = h;
+	}
+	uint64_t h = bytes;
+	for(uint64_t ch : hashes){
+		h = (h ^ ch) * 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static uint64_t align(uint64_t offset){
+	return (offset + cache_alignment - 1) & ~(cache_alignment - 1);
+}
+
+// segments have to lie inside the file and match the sizes storeIndexCache() writes for the recorded types,
+// a truncated or corrupted cache must not be attached
+static bool validEntry(const char *addr, const CacheColumn &e, uint64_t size, uint64_t zones, uint64_t file_size){
+	for(int seg=0; seg<SEG_COUNT; ++seg){
+		const uint64_t offset = e.segments[seg].offset;
+		const uint64_t bytes = e.segments[seg].bytes;
+		if(offset > file_size || bytes > file_size - offset || offset % sizeof(uint64_t) != 0){
+			return false;
+		}
+	}
+	auto bytes = [&](CacheSegment seg){ return e.segments[seg].bytes; };
+	auto words = [&](CacheSegment seg){ return e.segments[seg].bytes / sizeof(uint64_t); };
+	auto isCapacity = [](uint64_t capacity){ return capacity >= 2 && (capacity & (capacity - 1)) == 0; };
+
+	uint64_t column_bytes;
+	switch(e.column_type){
+		case 0: column_bytes = 0; break;
+		case 1: column_bytes = size*sizeof(uint32_t); break;
+		case 2: column_bytes = size*sizeof(uint16_t); break;
+		case 3: column_bytes = size*sizeof(uint8_t); break;
+		case 4:
+			if(e.column_bits == 0 || e.column_bits > 64) return false;
+			column_bytes = bitpacked_t::numberOfWords(size, e.column_bits)*sizeof(uint64_t);
+			break;
+		default: return false;
+	}
+	if(bytes(SEG_COLUMN) != column_bytes
+		|| bytes(SEG_DICTIONARY) != e.dictionary_size*sizeof(uint64_t)
+		|| bytes(SEG_ZONEMAP) != zones*sizeof(ZoneMap)
+		|| bytes(SEG_STATISTICS) != sizeof(ColumnStatistics)
+	){
+		return false;
+	}
+
+	// same domain as getIndexDomain()
+	uint64_t min = e.info.min, max = e.info.max;
+	if(e.dictionary_size){
+		min = 0;
+		max = e.dictionary_size - 1;
+	}
+	const bool array_domain = min <= max && max - min < file_size / sizeof(uint64_t);
+	switch(e.bt_type){
+		case 0: if(bytes(SEG_BITSET) != 0) return false; break;
+		case 1: if(!array_domain || words(SEG_BITSET) != (max-min+1)/64 + 1) return false; break;
+		case 2: if(bytes(SEG_BITSET) % (2*sizeof(uint64_t)) != 0 || !isCapacity(words(SEG_BITSET) / 2)) return false; break;
+		default: return false;
+	}
+	switch(e.ht_type){
+		case 0: if(bytes(SEG_HT_ARRAY) != 0 || bytes(SEG_HT_ROWS) != 0) return false; break;
+		case 1: {
+			if(!array_domain || words(SEG_HT_ARRAY) != max-min+2 || words(SEG_HT_ROWS) > size) return false;
+			// last offset is the number of rows
+			const uint64_t *offsets = reinterpret_cast<const uint64_t*>(addr + e.segments[SEG_HT_ARRAY].offset);
+			if(offsets[max-min+1] != words(SEG_HT_ROWS)) return false;
+			break;
+		}
+		case 2: if(!array_domain || words(SEG_HT_ARRAY) != max-min+1 || bytes(SEG_HT_ROWS) != 0) return false; break;
+		case 3:
+			if(bytes(SEG_HT_ARRAY) % (3*sizeof(uint64_t)) != 0 || !isCapacity(words(SEG_HT_ARRAY) / 3)
+				|| words(SEG_HT_ROWS) != size) return false;
+			break;
+		case 4:
+			if(bytes(SEG_HT_ARRAY) % (2*sizeof(uint64_t)) != 0 || !isCapacity(words(SEG_HT_ARRAY) / 2)
+				|| bytes(SEG_HT_ROWS) != 0) return false;
+			break;
+		default: return false;
+	}
+	return true;
+}
+
+
+bool Relation::loadIndexCache(){
+	std::string cname = fname + ".idx";
+	int fd = open(cname.c_str(), O_RDONLY);
+	if(fd == -1){
+		// no cache yet
+		return false;
+	}
+	struct stat s;
+	if(fstat(fd, &s) == -1 || (uint64_t)s.st_size < sizeof(CacheHeader)){
+		close(fd);
+		return false;
+	}
+	char *addr = reinterpret_cast<char*>(mmap(nullptr, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+	close(fd);
+	if(addr == MAP_FAILED){
+		perror("failed to mmap index cache");
+		return false;
+	}
+	const CacheHeader *header = reinterpret_cast<const CacheHeader*>(addr);
+	const size_t num_columns = getNumberOfColumns();
+	if(memcmp(header->magic, cache_magic, sizeof(cache_magic)) != 0
+		|| header->version != cache_version
+		|| header->options != cache_options
+		|| header->size != size
+		|| header->num_columns != num_columns
+		|| (uint64_t)s.st_size < sizeof(CacheHeader) + num_columns*sizeof(CacheColumn)
+		|| header->checksum != checksum(mapped_addr, fsize)
+	){
+		fprintf(stderr, "index cache %s is stale, recalculating\n", cname.c_str());
+		munmap(addr, s.st_size);
+		return false;
+	}
+	const CacheColumn *entries = reinterpret_cast<const CacheColumn*>(addr + sizeof(CacheHeader));
+	for(size_t c=0; c<num_columns; ++c){
+		if(!validEntry(addr, entries[c], size, getNumberOfZones(), s.st_size)){
+			fprintf(stderr, "index cache %s is corrupted, recalculating\n", cname.c_str());
+			munmap(addr, s.st_size);
+			return false;
+		}
+	}
+	cache_addr = addr;
+	cache_size = s.st_size;
+
+	stats_init();
+	for(size_t c=0; c<num_columns; ++c){
+		const CacheColumn &e = entries[c];
+		auto segment = [&](CacheSegment seg){
+			return reinterpret_cast<uint64_t*>(addr + e.segments[seg].offset);
+		};
+		infos[c] = e.info;
+		zonemaps[c] = reinterpret_cast<ZoneMap*>(segment(SEG_ZONEMAP));
+		statistics[c] = reinterpret_cast<ColumnStatistics*>(segment(SEG_STATISTICS));
+		columns[c].base = e.column_base;
+		if(e.dictionary_size){
+			columns[c].dictionary = segment(SEG_DICTIONARY);
+			columns[c].dictionary_size = e.dictionary_size;
+		}
+		switch(e.column_type){
+			case 0: /* stays in relation file */ break;
+			case 1: columns[c].data = reinterpret_cast<uint32_t*>(segment(SEG_COLUMN)); break;
+			case 2: columns[c].data = reinterpret_cast<uint16_t*>(segment(SEG_COLUMN)); break;
+			case 3: columns[c].data = reinterpret_cast<uint8_t*>(segment(SEG_COLUMN)); break;
+			case 4: columns[c].data = bitpacked_t{segment(SEG_COLUMN), e.column_bits}; break;
+		}
+		placeMapping(segment(SEG_COLUMN), e.segments[SEG_COLUMN].bytes);
+		// indexes of dictionary-encoded columns are on codes
+		const auto [min, max] = getIndexDomain(c);
+		// capacity of hash tables follows from segment size
+		const uint64_t bt_bytes = e.segments[SEG_BITSET].bytes;
+		const uint64_t ht_bytes = e.segments[SEG_HT_ARRAY].bytes;
+		switch(e.bt_type){
+			case 1: BTs[c].emplace<BitsetTable>().attach(min, max, segment(SEG_BITSET)); break;
+			case 2: BTs[c].emplace<HTsu_t>(segment(SEG_BITSET), bt_bytes / (2*sizeof(uint64_t))); break;
+		}
+		switch(e.ht_type){
+			case 1: HTs[c].emplace<HT_t>(min, max, segment(SEG_HT_ARRAY), segment(SEG_HT_ROWS)); break;
+			case 2: HTs[c].emplace<HTu_t>(min, max, segment(SEG_HT_ARRAY)); break;
+			case 3: HTs[c].emplace<HTs_t>(segment(SEG_HT_ARRAY), ht_bytes / (3*sizeof(uint64_t)), segment(SEG_HT_ROWS), size); break;
+			case 4: HTs[c].emplace<HTsu_t>(segment(SEG_HT_ARRAY), ht_bytes / (2*sizeof(uint64_t))); break;
+		}
+		for(int kind=0; kind<INDEX_KINDS; ++kind){
+			indexes[c*INDEX_KINDS + kind].state = INDEX_READY;
+		}
+	}
+#ifndef QUIET
+	printf("mapped index cache %s\n", cname.c_str());
+#endif
+	return true;
+}
+
+void Relation::storeIndexCache() const{
+	if(appended){
+		// cache is validated against the relation file, which does not contain appended tuples
+		fprintf(stderr, "%s has appended tuples, index cache not stored\n", fname.c_str());
+		return;
+	}
+	const size_t num_columns = getNumberOfColumns();
+	// cache has to be complete, build indexes which were skipped so far
+	for(size_t c=0; c<num_columns; ++c){
+		if(!ensureIndex(c, INDEX_BT) || !ensureIndex(c, INDEX_HT)){
+			fprintf(stderr, "indexes of %s exceed memory budget, index cache not stored\n", fname.c_str());
+			return;
+		}
+	}
+	CacheHeader header;
+	memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.version = cache_version;
+	header.options = cache_options;
+	header.checksum = checksum(mapped_addr, fsize);
+	header.size = size;
+	header.num_columns = num_columns;
+
+	// lay out segments
+	std::vector<CacheColumn> entries(num_columns);
+	std::vector<const void*> data(num_columns * SEG_COUNT, nullptr);
+	uint64_t offset = sizeof(CacheHeader) + num_columns*sizeof(CacheColumn);
+	for(size_t c=0; c<num_columns; ++c){
+		CacheColumn &e = entries[c];
+		e.info = infos[c];
+		e.column_type = columns[c].data.index();
+		e.column_base = columns[c].base;
+		e.column_bits = 0;
+		e.dictionary_size = columns[c].dictionary_size;
+		e.bt_type = BTs[c].index();
+		e.ht_type = HTs[c].index();
+		auto add = [&](CacheSegment seg, const void *ptr, uint64_t bytes){
+			offset = align(offset);
+			e.segments[seg] = {offset, bytes};
+			data[c*SEG_COUNT + seg] = ptr;
+			offset += bytes;
+		};
+		const column_data_t &col = columns[c].data;
+		switch(col.index()){
+			case 0: add(SEG_COLUMN, nullptr, 0); break;
+			case 1: add(SEG_COLUMN, std::get<uint32_t*>(col), size*sizeof(uint32_t)); break;
+			case 2: add(SEG_COLUMN, std::get<uint16_t*>(col), size*sizeof(uint16_t)); break;
+			case 3: add(SEG_COLUMN, std::get<uint8_t*>(col), size*sizeof(uint8_t)); break;
+			case 4: {
+				const bitpacked_t &packed = std::get<bitpacked_t>(col);
+				e.column_bits = packed.bits;
+				add(SEG_COLUMN, packed.words, bitpacked_t::numberOfWords(size, packed.bits)*sizeof(uint64_t));
+				break;
+			}
+		}
+		add(SEG_DICTIONARY, columns[c].dictionary, columns[c].dictionary_size*sizeof(uint64_t));
+		add(SEG_ZONEMAP, zonemaps[c], getNumberOfZones()*sizeof(ZoneMap));
+		add(SEG_STATISTICS, statistics[c], sizeof(ColumnStatistics));
+		switch(BTs[c].index()){
+			case 1: {
+				const BitsetTable &bt = std::get<BitsetTable>(BTs[c]);
+				add(SEG_BITSET, bt.getData(), bt.getDataSize()*sizeof(uint64_t));
+				break;
+			}
+			case 2: {
+				const HTsu_t &set = std::get<HTsu_t>(BTs[c]);
+				add(SEG_BITSET, set.getSlots(), set.getSlotsSize()*sizeof(uint64_t));
+				break;
+			}
+			default:
+				add(SEG_BITSET, nullptr, 0);
+				break;
+		}
+		switch(HTs[c].index()){
+			case 1: {
+				const HT_t &ht = std::get<HT_t>(HTs[c]);
+				add(SEG_HT_ARRAY, ht.getOffsets(), ht.getOffsetsSize()*sizeof(uint64_t));
+				add(SEG_HT_ROWS, ht.getRows(), ht.getRowsSize()*sizeof(uint64_t));
+				break;
+			}
+			case 2: {
+				const HTu_t &ht = std::get<HTu_t>(HTs[c]);
+				add(SEG_HT_ARRAY, ht.getArray(), ht.getArraySize()*sizeof(uint64_t));
+				add(SEG_HT_ROWS, nullptr, 0);
+				break;
+			}
+			case 3: {
+				const HTs_t &ht = std::get<HTs_t>(HTs[c]);
+				add(SEG_HT_ARRAY, ht.getSlots(), ht.getSlotsSize()*sizeof(uint64_t));
+				add(SEG_HT_ROWS, ht.getRows(), ht.getRowsSize()*sizeof(uint64_t));
+				break;
+			}
+			case 4: {
+				const HTsu_t &ht = std::get<HTsu_t>(HTs[c]);
+				add(SEG_HT_ARRAY, ht.getSlots(), ht.getSlotsSize()*sizeof(uint64_t));
+				add(SEG_HT_ROWS, nullptr, 0);
+				break;
+			}
+			default:
+				add(SEG_HT_ARRAY, nullptr, 0);
+				add(SEG_HT_ROWS, nullptr, 0);
+				break;
+		}
+	}
+
+	// write to temporary file and rename, readers never see a partial cache
+	std::string cname = fname + ".idx";
+	std::string tmpname = cname + ".tmp";
+	FILE *fd = fopen(tmpname.c_str(), "wb");
+	if(!fd){
+		perror("failed to create index cache");
+		return;
+	}
+	static const char padding[cache_alignment] = {};
+	bool ok = fwrite(&header, sizeof(header), 1, fd) == 1
+		&& fwrite(entries.data(), sizeof(CacheColumn), num_columns, fd) == num_columns;
+	uint64_t written = sizeof(header) + num_columns*sizeof(CacheColumn);
+	for(size_t c=0; ok && c<num_columns; ++c){
+		for(int seg=0; ok && seg<SEG_COUNT; ++seg){
+			const auto &segment = entries[c].segments[seg];
+			ok = fwrite(padding, 1, segment.offset - written, fd) == segment.offset - written
+				&& (segment.bytes == 0 || fwrite(data[c*SEG_COUNT + seg], 1, segment.bytes, fd) == segment.bytes);
+			written = segment.offset + segment.bytes;
+		}
+	}
+	if(fclose(fd) != 0 || !ok){
+		perror("failed to write index cache");
+		unlink(tmpname.c_str());
+		return;
+	}
+	if(rename(tmpname.c_str(), cname.c_str()) != 0){
+		perror("failed to rename index cache");
+		unlink(tmpname.c_str());
+	}
+#ifndef QUIET
+	printf("stored index cache %s (%lu bytes)\n", cname.c_str(), offset);
+#endif
+}
@@ -1,6 +1,10 @@
 #include "Query.h"
 
 #include <algorithm>
+#include <deque>
+#include <numeric>
+
+#include <omp.h>
 
 #include "ScanOperator.h"
 #include "FilterOperator.h"
@@ -8,6 +12,7 @@
 #include "JoinOperator.h"
 #include "JoinUniqueOperator.h"
 #include "SemiJoinOperator.h"
+#include "CountingSemiJoinOperator.h"
 #include "ProjectionOperator.h"
 
 
@@ -99,15 +104,229 @@ void Query::parse(char *line){
 	}
 }
 
+// fraction of tuples of a relation passing the filter, estimated with the column statistics
+static double estimateSelectivity(const Relation &rel, const Filter &f){
+	const ColumnStatistics &stat = rel.getColumnStatistics(f.sel.columnId);
+	switch(f.comparison){
+		case Filter::Comparison::Equal:   return stat.selectivityEqual(f.constant);
+		case Filter::Comparison::Less:    return stat.selectivityLess(f.constant);
+		case Filter::Comparison::Greater: return stat.selectivityGreater(f.constant);
+	}
+	return 1.0;
+}
+
+// number of distinct values in a column, exact if the bitset was already built
+static double estimateDistinct(const Relation &rel, unsigned column){
+	const uint64_t distinct = rel.getColumnInfo(column).distinct;
+	return std::max(1.0, distinct ? double(distinct) : rel.getColumnStatistics(column).estimateDistinct());
+}
+
+// true if the same filter is on the other column of a join predicate, join results satisfy it already
+static bool impliedByJoin(const std::vector<Filter> &filters, const Filter &f, const Selection &other){
+	return std::any_of(filters.begin(), filters.end(), [&](const Filter &g){
+		return g.sel == other && g.comparison == f.comparison && g.constant == f.constant;
+	});
+}
+
+#ifdef REWRITE_EQUIVALENCE
+// columns connected by join predicates hold the same values in every result tuple,
+// each filter is replicated to all columns of its equivalence class
+static std::vector<Filter> propagateFilters(const std::vector<Predicate> &predicates, const std::vector<Filter> &filters){
+	// union-find over the join columns
+	std::vector<Selection> columns;
+	std::vector<unsigned> parent;
+	auto indexOf = [&](const Selection &sel) -> unsigned {
+		return std::find(columns.begin(), columns.end(), sel) - columns.begin();
+	};
+	auto insert = [&](const Selection &sel){
+		const unsigned i = indexOf(sel);
+		if(i == columns.size()){
+			parent.push_back(i);
+			columns.emplace_back(sel.relationId, sel.columnId);
+		}
+		return i;
+	};
+	auto root = [&](unsigned i){
+		while(parent[i] != i){
+			i = parent[i] = parent[parent[i]];
+		}
+		return i;
+	};
+	for(const Predicate &p : predicates){
+		const unsigned left = insert(p.left), right = insert(p.right);
+		parent[root(left)] = root(right);
+	}
+
+	std::vector<Filter> propagated;
+	auto add = [&](const Selection &sel, const Filter &f){
+		const bool duplicate = std::any_of(propagated.begin(), propagated.end(), [&](const Filter &g){
+			return g.sel == sel && g.comparison == f.comparison && g.constant == f.constant;
+		});
+		if(!duplicate){
+			propagated.emplace_back(sel.relationId, sel.columnId, f.constant, f.comparison);
+		}
+	};
+	for(const Filter &f : filters){
+		// filtered column first, then the rest of its class
+		add(f.sel, f);
+		const unsigned i = indexOf(f.sel);
+		if(i == columns.size()) continue;
+		for(unsigned j=0; j<columns.size(); ++j){
+			if(root(j) == root(i)){
+				add(columns[j], f);
+			}
+		}
+	}
+	return propagated;
+}
+#endif
+
+// costs in units of one probe into a precalculated index or one join result, measured with 4M uniform keys
+// and domains of 64k to 8M keys: filtering costs 0.1 to 0.4 units per scanned tuple,
+// building the table 3 to 8 units per passing tuple, both dominated by memory traffic
+static constexpr double scan_cost_per_tuple = 0.25;
+static constexpr double build_cost_per_tuple = 4.0;
+
+// build pipeline scanning and filtering a relation, table on the passing tuples
+static double buildCost(double tuples, double passing){
+	return tuples * (scan_cost_per_tuple + passing * build_cost_per_tuple);
+}
+
+// cost of joining a relation with a precalculated index and filtering the join result afterwards,
+// or with a build pipeline scanning and filtering the relation first, whichever is cheaper
+// returns the cost and true for the build pipeline
+static std::pair<double,bool> joinCost(double probes, double tuples, double selectivity, double passing){
+	const double joined = probes * tuples * selectivity;
+	const double precalculated = probes + joined;
+	const double filtered = buildCost(tuples, passing) + probes + joined * passing;
+	if(filtered < precalculated){
+		return {filtered, true};
+	}
+	return {precalculated, false};
+}
+
+#ifdef REWRITE_COSTBASED
+
+// join order with the smallest sum of intermediate results, dynamic programming over connected sets of bindings
+// plans are left-deep like the pipeline: first relation is scanned, all others probe their precalculated index
+// or a table built on their filtered tuples, cross products are never considered
+// returns the bindings in join order, empty if the join graph is not connected
+static std::vector<unsigned> costBasedOrder(
+	const std::vector<Relation> &relations, const std::vector<unsigned> &relationIds,
+	const std::vector<Predicate> &predicates, const std::vector<Filter> &filters
+){
+	const unsigned bindings = relationIds.size();
+	// tuples of each relation, and the fraction passing its self-joins
+	std::vector<double> tuples(bindings), passing(bindings, 1.0);
+	for(unsigned b=0; b<bindings; ++b){
+		tuples[b] = relations[relationIds[b]].getNumberOfTuples();
+	}
+	std::vector<double> filterSelectivity(filters.size());
+	for(size_t i=0; i<filters.size(); ++i){
+		filterSelectivity[i] = estimateSelectivity(relations[relationIds[filters[i].sel.relationId]], filters[i]);
+	}
+	// selectivity of an equi-join on columns with d1 and d2 distinct values: 1/max(d1,d2)
+	std::vector<double> joinSelectivity(predicates.size());
+	for(size_t i=0; i<predicates.size(); ++i){
+		const Predicate &p = predicates[i];
+		const double left  = estimateDistinct(relations[relationIds[p.left.relationId]],  p.left.columnId);
+		const double right = estimateDistinct(relations[relationIds[p.right.relationId]], p.right.columnId);
+		joinSelectivity[i] = 1.0 / std::max(left, right);
+		if(p.left.relationId == p.right.relationId){
+			passing[p.left.relationId] *= joinSelectivity[i];
+		}
+	}
+
+	struct Plan{
+		double cardinality;
+		double cost;
+		unsigned last; // binding joined last
+		bool valid;
+	};
+	// one plan per set of bindings, a set is smaller than all its supersets
+	std::vector<Plan> best(1u << bindings, Plan{0, 0, 0, false});
+	for(unsigned b=0; b<bindings; ++b){
+		// scan reads the whole relation, all its filters apply
+		double scanned = tuples[b] * passing[b];
+		for(size_t i=0; i<filters.size(); ++i){
+			if(filters[i].sel.relationId == b){
+				scanned *= filterSelectivity[i];
+			}
+		}
+		best[1u << b] = {scanned, tuples[b], b, true};
+	}
+	for(unsigned set=1; set<best.size(); ++set){
+		for(unsigned r=0; r<bindings; ++r){
+			const unsigned rest = set & ~(1u << r);
+			if(!(set & (1u << r)) || rest == 0 || !best[rest].valid) continue;
+			// all predicates between rest and r, first one joins, the others are applied as self-joins
+			bool connected = false;
+			double selectivity = 1.0;
+			for(size_t i=0; i<predicates.size(); ++i){
+				const Predicate &p = predicates[i];
+				const unsigned l = p.left.relationId, rr = p.right.relationId;
+				if((l == r && (rest & (1u << rr))) || (rr == r && (rest & (1u << l)))){
+					connected = true;
+					selectivity *= joinSelectivity[i];
+				}
+			}
+			if(!connected) continue;
+			// filters of r also on its join partner in rest are already applied to the probes
+			double residual = passing[r];
+			for(size_t f=0; f<filters.size(); ++f){
+				if(filters[f].sel.relationId != r) continue;
+				const bool implied = std::any_of(predicates.begin(), predicates.end(), [&](const Predicate &p){
+					return (p.left == filters[f].sel && (rest & (1u << p.right.relationId)) && impliedByJoin(filters, filters[f], p.right))
+						|| (p.right == filters[f].sel && (rest & (1u << p.left.relationId)) && impliedByJoin(filters, filters[f], p.left));
+				});
+				if(!implied){
+					residual *= filterSelectivity[f];
+				}
+			}
+			// every tuple probes, every match is produced before the filters of r are applied unless r is filtered first
+			const double probes = best[rest].cardinality;
+			const double cost = best[rest].cost + joinCost(probes, tuples[r], selectivity, residual).first;
+			if(!best[set].valid || cost < best[set].cost){
+				best[set] = {probes * tuples[r] * selectivity * residual, cost, r, true};
+			}
+		}
+	}
+
+	std::vector<unsigned> order;
+	unsigned set = best.size() - 1;
+	if(!best[set].valid) return order;
+	order.resize(bindings);
+	for(unsigned i=bindings; i-->0; ){
+		order[i] = best[set].last;
+		set &= ~(1u << order[i]);
+	}
+#ifndef QUIET
+	printf("estimated cost: %.0f\n", best.back().cost);
+#endif
+	return order;
+}
+#endif
+
 void Query::rewrite(const std::vector<Relation> &relations){
+#ifdef REWRITE_EQUIVALENCE
+	// before reordering, every relation is reduced by the filters of its equivalent columns
+	filters = propagateFilters(predicates, filters);
+#endif
 #ifdef REWRITE_ORDER
-	// reorder relations according to their "selectivity", most selective first
-	// poor mans approach: filter with equality first, relations size, filter on relation
 	std::vector<std::pair<unsigned,unsigned>> newOrder;
 	newOrder.reserve(relationIds.size());
 	for(size_t i=0; i<relationIds.size(); ++i){
 		newOrder.emplace_back(relationIds[i], i);
 	}
+#ifdef REWRITE_COSTBASED
+	// reorder relations by estimated cost of the left-deep plan
+	const std::vector<unsigned> order = costBasedOrder(relations, relationIds, predicates, filters);
+	for(size_t i=0; i<order.size(); ++i){
+		newOrder[i] = {relationIds[order[i]], order[i]};
+	}
+#else
+	// reorder relations according to their "selectivity", most selective first
+	// poor mans approach: filter with equality first, relations size, filter on relation
 	//HACK
 	uint64_t filterOnBinding=0, equalityFilterOnBinding=0;
 	for(const Filter &f : filters){
@@ -139,6 +358,7 @@ void Query::rewrite(const std::vector<Relation> &relations){
 			}
 		}
 	);
+#endif
 	// rewrite map for reordering, old binding to new binding
 	std::vector<unsigned> rewritemap(relationIds.size());
 	for(size_t i=0; i<newOrder.size(); ++i){
@@ -161,12 +381,20 @@ void Query::rewrite(const std::vector<Relation> &relations){
 	}
 	// reorder predicates
 	std::sort(predicates.begin(), predicates.end(), [](const Predicate &f, const Predicate &s){
+#ifdef REWRITE_COSTBASED
+		// in join order, relations are connected to an earlier one
+		if(f.right.relationId != s.right.relationId){
+			return f.right.relationId < s.right.relationId;
+		}
+		return f.left.relationId < s.left.relationId;
+#else
 #if 1
 		if(f.left.relationId == s.left.relationId){
 			return f.right.relationId < s.right.relationId;
 		}else
 #endif
 			return f.left.relationId < s.left.relationId;
+#endif
 	});
 	// check connectivity
 	unsigned usedRelations = 1U << predicates[0].left.relationId; // scanned
@@ -212,12 +440,12 @@ void Query::rewrite(const std::vector<Relation> &relations){
 #endif
 #endif
 
-	//  - replace equivalent columns with one column to reduce read columns
+	//  - replace equivalent columns with one column to reduce read columns, filters are on all of them
 	//  - remove identical joins or filter (0.0=1.0 & 0.0=1.0 & 1.0=0.0)
 	//    => effect in total very small
+	//  - remove filter which are pointless (0.0<10 & 0.0<12 or 0.1=10 & 0.1<12), detect empty results
+	//    => after propagation, every column of an equivalence class has the same filters
 	//TODO: other rewrites:
-	//  - remove filter which are pointless (0.0<10 & 0.0<12 or 0.1=10 & 0.1<12)
-	//    => only a few queries with very low runtime -> only tiny gain possible
 	//  - pointless self joins (0.0 = 0.0)
 	//    => because of reorder it does not happen anymore
 
@@ -237,21 +465,6 @@ void Query::rewrite(const std::vector<Relation> &relations){
 		printf("%u.%u=%u.%u, ", p.left.relationId, p.left.columnId, p.right.relationId, p.right.columnId);
 	}
 	printf("\n");
-#endif
-	// rewrite filter
-	for(auto &f : filters){
-		for(size_t pred=0,predsize=predicates.size(); pred<predsize; ++pred){
-			auto &predicate = predicates[pred];
-			if(f.sel == predicate.right){
-				f.sel = predicate.left;
-			}
-		}
-	}
-#ifndef QUIET
-	for(auto &f : filters){
-		printf("%u.%u%c%lu, ", f.sel.relationId, f.sel.columnId, f.comparison, f.constant);
-	}
-	printf("\n");
 #endif
 	// rewrite selections
 	for(auto &s : selections){
@@ -289,20 +502,259 @@ void Query::rewrite(const std::vector<Relation> &relations){
 	printf("\n");
 #endif
 #endif
+
+#ifdef REWRITE_PRUNE
+	prune(relations);
+#endif
+}
+
+std::vector<uint64_t> runBuildPipeline(const Relation &relation, unsigned binding, const std::vector<Filter> &filters, unsigned threads){
+	ScanOperator scan(relation, binding);
+	std::deque<FilterOperator> filterops;
+	for(const auto &f : filters){
+		if(f.sel.relationId == binding){
+#ifdef ZONEMAPS
+			scan.addZoneFilter(relation.getZoneMap(f.sel.columnId), f);
+#endif
+			filterops.emplace_back(relation, f);
+		}
+	}
+	const uint64_t morsels = scan.getMorsels(), tuples = scan.getTuples();
+	// per thread, each thread filters a contiguous range of morsels
+	std::vector<std::vector<uint64_t>> selected(threads);
+	#pragma omp parallel num_threads(threads)
+	{
+		const uint64_t team = omp_get_num_threads(), t = omp_get_thread_num();
+		std::vector<uint64_t> &rows = selected[t];
+		uint64_t passing[morsel_size];
+		for(uint64_t m=morsels*t/team, last=morsels*(t+1)/team; m<last; ++m){
+			if(scan.skipMorsel(m)) continue;
+			// no tuple-by-tuple operators: each filter runs over the whole morsel, the following ones only over the rows passing
+			const uint64_t begin = m*morsel_size, end = std::min((m+1)*morsel_size, tuples);
+			uint64_t count;
+			if(filterops.empty()){
+				count = end - begin;
+				std::iota(passing, passing + count, begin);
+			}else{
+				count = filterops.front().selectMorsel(begin, end, passing);
+				for(auto f=filterops.begin()+1; f!=filterops.end() && count; ++f){
+					count = f->selectRows(passing, count);
+				}
+			}
+			rows.insert(rows.end(), passing, passing + count);
+		}
+	}
+	// ascending, ranges of morsels are ascending in thread order
+	size_t count=0;
+	for(const auto &rows : selected){
+		count += rows.size();
+	}
+	std::vector<uint64_t> rowids;
+	rowids.reserve(count);
+	for(const auto &rows : selected){
+		rowids.insert(rowids.end(), rows.begin(), rows.end());
+	}
+	return rowids;
+}
+
+#ifdef REWRITE_PRUNE
+// values of a column which can pass its filters, inclusive bounds, empty if lo > hi
+struct ValueRange{
+	uint64_t lo, hi;
+};
+
+// true if it is certain that no value of the column lies in range
+// only exact information: min/max, zone maps and dictionary, histograms are sampled
+static bool provablyEmpty(const Relation &rel, unsigned column, const ValueRange &range){
+	const ColumnInfo &info = rel.getColumnInfo(column);
+	if(range.lo > range.hi || range.hi < info.min || range.lo > info.max) return true;
+	// every morsel outside
+	const ZoneMap *zones = rel.getZoneMap(column);
+	bool overlaps=false;
+	for(uint64_t z=0, zcount=rel.getNumberOfZones(); z<zcount && !overlaps; ++z){
+		overlaps = zones[z].min <= range.hi && zones[z].max >= range.lo;
+	}
+	if(!overlaps) return true;
+	// no dictionary entry in range
+	const column_t &col = rel.getColumn(column);
+	if(col.dictionary){
+		const uint64_t *dict_end = col.dictionary + col.dictionary_size;
+		const uint64_t *pos = std::lower_bound<const uint64_t*>(col.dictionary, dict_end, range.lo);
+		if(pos == dict_end || *pos > range.hi) return true;
+	}
+	return false;
+}
+
+void Query::prune(const std::vector<Relation> &relations){
+	auto columnRange = [&](const Selection &sel){
+		const ColumnInfo &info = relations[relationIds[sel.relationId]].getColumnInfo(sel.columnId);
+		return ValueRange{info.min, info.max};
+	};
+	// all filters on a column combined, in order of first filter on the column
+	std::vector<std::pair<Selection,ValueRange>> ranges;
+	for(const Filter &f : filters){
+		auto it = std::find_if(ranges.begin(), ranges.end(), [&f](const auto &r){ return r.first == f.sel; });
+		if(it == ranges.end()){
+			ranges.emplace_back(f.sel, columnRange(f.sel));
+			it = ranges.end() - 1;
+		}
+		ValueRange &range = it->second;
+		switch(f.comparison){
+			case Filter::Comparison::Equal:
+				range.lo = std::max(range.lo, f.constant);
+				range.hi = std::min(range.hi, f.constant);
+				break;
+			case Filter::Comparison::Less:
+				if(f.constant == 0) range = {1, 0};
+				else range.hi = std::min(range.hi, f.constant - 1);
+				break;
+			case Filter::Comparison::Greater:
+				if(f.constant == std::numeric_limits<uint64_t>::max()) range = {1, 0};
+				else range.lo = std::max(range.lo, f.constant + 1);
+				break;
+		}
+	}
+	for(const auto &[sel, range] : ranges){
+		if(provablyEmpty(relations[relationIds[sel.relationId]], sel.columnId, range)){
+			empty = true;
+			return;
+		}
+	}
+	// both sides of a join predicate need a common value
+	auto rangeOf = [&](const Selection &sel){
+		auto it = std::find_if(ranges.begin(), ranges.end(), [&sel](const auto &r){ return r.first == sel; });
+		return it != ranges.end() ? it->second : columnRange(sel);
+	};
+	for(const Predicate &p : predicates){
+		const ValueRange left = rangeOf(p.left), right = rangeOf(p.right);
+		const ValueRange common{std::max(left.lo, right.lo), std::min(left.hi, right.hi)};
+		if(provablyEmpty(relations[relationIds[p.left.relationId]], p.left.columnId, common)
+			|| provablyEmpty(relations[relationIds[p.right.relationId]], p.right.columnId, common)){
+			empty = true;
+			return;
+		}
+	}
+	// smallest set of filters describing the ranges, filters passing all values of the column are dropped
+	std::vector<Filter> pruned;
+	for(const auto &[sel, range] : ranges){
+		const ValueRange all = columnRange(sel);
+		if(range.lo == range.hi && all.lo != all.hi){
+			pruned.emplace_back(sel.relationId, sel.columnId, range.lo, Filter::Comparison::Equal);
+			continue;
+		}
+		if(range.lo > all.lo){
+			pruned.emplace_back(sel.relationId, sel.columnId, range.lo - 1, Filter::Comparison::Greater);
+		}
+		if(range.hi < all.hi){
+			pruned.emplace_back(sel.relationId, sel.columnId, range.hi + 1, Filter::Comparison::Less);
+		}
+	}
+#ifndef QUIET
+	printf("filters: %lu -> %lu\n", filters.size(), pruned.size());
+#endif
+	filters = std::move(pruned);
+}
+#endif
+
+std::vector<JoinPlan> Query::plan(const std::vector<Relation> &relations) const{
+	std::vector<JoinPlan> steps(predicates.size());
+	// left-deep in order of predicates
+	const unsigned binding = predicates[0].left.relationId;
+	const unsigned relid = relationIds[binding];
+	unsigned usedRelations = 1u << binding; // bitset, assumes small number of relations
+	// estimated number of tuples flowing through the pipeline, decides about build pipelines
+	double cardinality = relations[relid].getNumberOfTuples();
+	// fraction of tuples of the scanned relation passing its filters
+	for(const auto &f : filters){
+		if(f.sel.relationId == binding){
+			cardinality *= estimateSelectivity(relations[relid], f);
+		}
+	}
+	for(size_t pred=0, predsize=predicates.size(); pred<predsize; ++pred){
+		const auto &p = predicates[pred];
+		JoinPlan &step = steps[pred];
+		//FIXME: only works if left side is already joined or scanned
+		if(!(usedRelations & (1u << p.left.relationId))){
+			step.kind = JoinPlan::Retry;
+			continue;
+		}
+		const unsigned relid_right = relationIds[p.right.relationId];
+		const unsigned relid_left = relationIds[p.left.relationId];
+		// if right side is also known, circular join graph, kind of filter, does not join new relation
+		if(usedRelations & (1u << p.right.relationId)){
+			step.kind = JoinPlan::SelfJoin;
+			cardinality /= std::max(estimateDistinct(relations[relid_left], p.left.columnId), estimateDistinct(relations[relid_right], p.right.columnId));
+			continue;
+		}
+		const double tuples = relations[relid_right].getNumberOfTuples();
+		const double distinct = std::max(estimateDistinct(relations[relid_left], p.left.columnId), estimateDistinct(relations[relid_right], p.right.columnId));
+		// filters also on the left join column hold for all join results, they are not applied again
+		bool hasFilters=false;
+		double residual = 1.0;
+		for(const auto &f : filters){
+			if(f.sel.relationId == p.right.relationId && !(f.sel == p.right && impliedByJoin(filters, f, p.left))){
+				hasFilters = true;
+				residual *= estimateSelectivity(relations[relid_right], f);
+			}
+		}
+		// check if right-side relation is used later or just semijoin
+		bool joinedLater=false;
+		// check following predicates
+		for(size_t pred2=pred+1; pred2<predsize; ++pred2){
+			const auto &p2 = predicates[pred2];
+			if(p2.left.relationId == p.right.relationId || p2.right.relationId == p.right.relationId){
+				joinedLater = true;
+				break;
+			}
+		}
+		// check selections
+		for(const auto &s : selections){
+			if(s.relationId == p.right.relationId){
+				step.projected.push_back(s.columnId);
+			}
+		}
+		// semijoin with a plain bitset only works if the column is unique
+		// otherwise the join partners are counted, projection multiplies its sums with the count
+		const bool unique = relations[relid_right].isUnique(p.right.columnId);
+		// eager aggregation if the relation only contributes sums: group its rows by join key,
+		// sums and count of the group instead of enumerating all join partners
+		const bool aggregate = !unique && !joinedLater && !step.projected.empty()
+			&& cardinality * tuples / distinct > buildCost(tuples, residual);
+		// scan and filter the relation first if cheaper than dropping join results afterwards, always before grouping
+		step.filtered = hasFilters && (aggregate || joinCost(cardinality, tuples, 1.0 / distinct, residual).second);
+		if(aggregate){
+			step.kind = JoinPlan::Aggregate;
+			// tuples with a group pass once
+			cardinality *= std::min(1.0, tuples / distinct * residual);
+			usedRelations |= 1u << p.right.relationId;
+			continue;
+		}
+		cardinality *= tuples / distinct * residual;
+		step.used = joinedLater || (hasFilters && !step.filtered) || !step.projected.empty();
+		step.kind = step.used || !unique ? JoinPlan::Join : JoinPlan::SemiJoin;
+		if(step.used){
+			usedRelations |= 1u << p.right.relationId;
+		}
+	}
+	return steps;
 }
 
 std::pair<ScanOperator*,ProjectionOperator*> Query::constructPipeline(const std::vector<Relation> &relations){
+	const std::vector<JoinPlan> steps = plan(relations);
 	// create pipeline, left-deep in order of predicates
 	unsigned binding = predicates[0].left.relationId;
 	// get relation id in database instead of binding in query
 	const unsigned relid = relationIds[binding];
-	// keep track of which relations are scanned/joined already
-	unsigned usedRelations = 1u << binding; // bitset, assumes small number of relations
 	ScanOperator *scan = new ScanOperator(relations[relid]);
 	Operator *lastop = scan;
+	// bindings replaced by groups of eager aggregation
+	std::vector<std::pair<unsigned,const Aggregate*>> aggregated;
 	// find filters for the scanned relation
 	for(const auto &f : filters){
 		if(f.sel.relationId == binding){
+#ifdef ZONEMAPS
+			scan->addZoneFilter(relations[relid].getZoneMap(f.sel.columnId), f);
+#endif
 			FilterOperator *filter = new FilterOperator(relations[relid], f);
 			lastop->setNext(filter);
 			lastop = filter;
@@ -312,100 +764,160 @@ std::pair<ScanOperator*,ProjectionOperator*> Query::constructPipeline(const std:
 	//  - next join, check if joined table has filter -> create hash table or use precalced
 	for(size_t pred=0, predsize=predicates.size(); pred<predsize; ++pred){
 		const auto &p = predicates[pred];
-		//FIXME: only works if left side is already joined or scanned
-		if(usedRelations & (1u << p.left.relationId)){
-			unsigned relid_right = relationIds[p.right.relationId];
-			unsigned relid_left = relationIds[p.left.relationId];
-			// if right side is also known, circular join graph, kind of filter, does not join new relation
-			if(usedRelations & (1u << p.right.relationId)){
-				// no new relation, similar to filter
-				SelfJoinOperator *selfjoin = new SelfJoinOperator(relations[relid_left], relations[relid_right], p.left, p.right);
-				lastop->setNext(selfjoin);
-				lastop = selfjoin;
+		const JoinPlan &step = steps[pred];
+		const bool filtered = step.filtered;
+		const unsigned relid_right = relationIds[p.right.relationId];
+		const unsigned relid_left = relationIds[p.left.relationId];
+		if(step.kind == JoinPlan::Retry){
+			//TODO: retry later, not needed it workload it seems
+			fprintf(stderr, "not implemented retry\n");
+			continue;
+		}
+		if(step.kind == JoinPlan::SelfJoin){
+			// no new relation, similar to filter
+			SelfJoinOperator *selfjoin = new SelfJoinOperator(relations[relid_left], relations[relid_right], p.left, p.right);
+			lastop->setNext(selfjoin);
+			lastop = selfjoin;
+			continue;
+		}
+		std::vector<uint64_t> rowids;
+		if(filtered){
+			rowids = runBuildPipeline(relations[relid_right], p.right.relationId, filters, index_build_threads);
+#ifndef QUIET
+			printf("build pipeline: %lu of %lu tuples\n", rowids.size(), relations[relid_right].getNumberOfTuples());
+#endif
+		}
+		if(step.kind == JoinPlan::Aggregate){
+			Aggregate &agg = temporaryAggregates.emplace_back();
+			relations[relid_right].buildAggregate(p.right.columnId, step.projected, filtered ? &rowids : nullptr, agg, index_build_threads);
+			// binds the relation to the group of the key
+			Operator *join;
+			if(agg.groups.index() == 2){
+				join = new JoinUniqueOperator<HTu_t>(relations[relid_left], p.left, p.right, std::get_if<HTu_t>(&agg.groups), relations[relid_right].getColumn(p.right.columnId));
 			}else{
-				// check if right-side relation is used later or just semijoin
-				bool used=false;
-				// check following predicates
-				for(size_t pred2=pred+1; pred2<predsize; ++pred2){
-					const auto &p2 = predicates[pred2];
-					if(p2.left.relationId == p.right.relationId || p2.right.relationId == p.right.relationId){
-						used = true;
-						break;
-					}
-				}
-				// check filters
-				for(const auto &f : filters){
-					if(f.sel.relationId == p.right.relationId/*binding*/){
-						used = true;
+				join = new JoinUniqueOperator<HTsu_t>(relations[relid_left], p.left, p.right, std::get_if<HTsu_t>(&agg.groups), relations[relid_right].getColumn(p.right.columnId));
+			}
+			lastop->setNext(join);
+			lastop = join;
+			aggregated.emplace_back(p.right.relationId, &agg);
+#ifndef QUIET
+			printf("eager aggregation: %lu groups\n", agg.counts.size());
+#endif
+		}else if(step.kind == JoinPlan::Join){
+			// get relation id in database instead of binding in query
+			const hashtable_t *ht;
+			if(filtered){
+				// only the rows passing the filters
+				relations[relid_right].buildFilteredHT(p.right.columnId, rowids, temporaryHTs.emplace_back(), index_build_threads);
+				ht = &temporaryHTs.back();
+			}else if(!(ht = relations[relid_right].getHT(p.right.columnId))){
+				// query-time build
+				relations[relid_right].buildHT(p.right.columnId, temporaryHTs.emplace_back());
+				ht = &temporaryHTs.back();
+#ifndef QUIET
+				puts("temporary hashtable, memory budget exhausted");
+#endif
+			}
+			Operator *join;
+			switch(ht->index()){
+				case 0:
+					fprintf(stderr, "monostate variant\n");
+					exit(1);
+					break;
+				case 1:
+					if(!step.used){
+						join = new CountingSemiJoinOperator<HT_t>(relations[relid_left], p.left, std::get_if<HT_t>(ht), relations[relid_right].getColumn(p.right.columnId));
+#ifndef QUIET
+						puts("counting semijoin used");
+#endif
 						break;
 					}
-				}
-				// check selections
-				for(const auto &s : selections){
-					if(s.relationId == p.right.relationId){
-						used = true;
+					join = new JoinOperator<HT_t>(relations[relid_left], p.left, p.right, std::get_if<HT_t>(ht), relations[relid_right].getColumn(p.right.columnId));
+					break;
+				case 2:
+					join = new JoinUniqueOperator<HTu_t>(relations[relid_left], p.left, p.right, std::get_if<HTu_t>(ht), relations[relid_right].getColumn(p.right.columnId));
+					break;
+				case 3:
+					if(!step.used){
+						join = new CountingSemiJoinOperator<HTs_t>(relations[relid_left], p.left, std::get_if<HTs_t>(ht), relations[relid_right].getColumn(p.right.columnId));
+#ifndef QUIET
+						puts("counting semijoin used");
+#endif
 						break;
 					}
+					join = new JoinOperator<HTs_t>(relations[relid_left], p.left, p.right, std::get_if<HTs_t>(ht), relations[relid_right].getColumn(p.right.columnId));
+					break;
+				case 4:
+					join = new JoinUniqueOperator<HTsu_t>(relations[relid_left], p.left, p.right, std::get_if<HTsu_t>(ht), relations[relid_right].getColumn(p.right.columnId));
+					break;
+
+				default:
+					fprintf(stderr, "unexpected index in variant of hashtables: %lu\n", ht->index());
+					exit(1);
+			}
+			lastop->setNext(join);
+			lastop = join;
+			//HACK: handle filter predicates on joined relations
+			// find filters for newly joined relation
+			for(const auto &f : filters){
+				if(!filtered && f.sel.relationId == p.right.relationId/*binding*/ && !(f.sel == p.right && impliedByJoin(filters, f, p.left))){
+					FilterOperator *filter = new FilterOperator(relations[relid_right], f);
+					lastop->setNext(filter);
+					lastop = filter;
 				}
-				//TODO: semijoin with a plain bitset only works if the column is unique
-				//      otherwise we have to "multiply" with the number of occurences
-				//      very specific to programming contest as we sum every projected column
+			}
+		}else{
+			// semijoin
+			const bitset_t *bt;
+			if(filtered){
+				relations[relid_right].buildFilteredBT(p.right.columnId, rowids, temporaryBTs.emplace_back(), index_build_threads);
+				bt = &temporaryBTs.back();
+			}else if(!(bt = relations[relid_right].getBT(p.right.columnId))){
+				// query-time build
+				relations[relid_right].buildBT(p.right.columnId, temporaryBTs.emplace_back());
+				bt = &temporaryBTs.back();
 #ifndef QUIET
-				if(!used && p.right.columnId!=0){
-					puts("semijoin possible on non-unique column");
-				}
+				puts("temporary bitset, memory budget exhausted");
 #endif
-				if(used || p.right.columnId!=0){ //HACK
-					usedRelations |= 1u << p.right.relationId;
-					// get relation id in database instead of binding in query
-					const auto *ht = relations[relid_right].getHT(p.right.columnId);
-					Operator *join;
-					switch(ht->index()){
-						case 0:
-							fprintf(stderr, "monostate variant\n");
-							exit(1);
-							break;
-						case 1:
-							join = new JoinOperator(relations[relid_left], p.left, p.right, std::get_if<HT_t>(ht));
-							break;
-						case 2:
-							join = new JoinUniqueOperator(relations[relid_left], p.left, p.right, std::get_if<HTu_t>(ht));
-							break;
-
-						default:
-							fprintf(stderr, "unexpected index in variant of hashtables: %lu\n", ht->index());
-							exit(1);
-					}
-					lastop->setNext(join);
-					lastop = join;
-					//HACK: handle filter predicates on joined relations
-					// find filters for newly joined relation
-					for(const auto &f : filters){
-						if(f.sel.relationId == p.right.relationId/*binding*/){
-							FilterOperator *filter = new FilterOperator(relations[relid_right], f);
-							lastop->setNext(filter);
-							lastop = filter;
-						}
-					}
-				}else{
-					// semijoin
-					const auto *bt = relations[relid_right].getBT(p.right.columnId);
-					SemiJoinOperator *semijoin = new SemiJoinOperator(relations[relid_left], p.left, bt);
-					lastop->setNext(semijoin);
-					lastop = semijoin;
+			}
+			Operator *semijoin;
+			switch(bt->index()){
+				case 1:
+					semijoin = new SemiJoinOperator<BitsetTable>(relations[relid_left], p.left, std::get_if<BitsetTable>(bt), relations[relid_right].getColumn(p.right.columnId));
+					break;
+				case 2:
+					semijoin = new SemiJoinOperator<HTsu_t>(relations[relid_left], p.left, std::get_if<HTsu_t>(bt), relations[relid_right].getColumn(p.right.columnId));
+					break;
+
+				default:
+					fprintf(stderr, "unexpected index in variant of bitsets: %lu\n", bt->index());
+					exit(1);
+			}
+			lastop->setNext(semijoin);
+			lastop = semijoin;
 #ifndef QUIET
-					puts("semijoin used");
+			puts("semijoin used");
 #endif
-				}
-			}
-		}else{
-			//TODO: retry later, not needed it workload it seems
-			fprintf(stderr, "not implemented retry\n");
 		}
 	}
 
+	// columns of the scanned relation read by the pipeline
+	for(const auto &f : filters){
+		if(f.sel.relationId == binding) scan->addColumn(f.sel.columnId);
+	}
+	for(const auto &p : predicates){
+		if(p.left.relationId == binding) scan->addColumn(p.left.columnId);
+		if(p.right.relationId == binding) scan->addColumn(p.right.columnId);
+	}
+	for(const auto &s : selections){
+		if(s.relationId == binding) scan->addColumn(s.columnId);
+	}
+
 	// aggregation at the end
 	ProjectionOperator *proj = new ProjectionOperator(relations, relationIds, selections);
+	for(const auto &[binding, agg] : aggregated){
+		proj->aggregate(binding, *agg);
+	}
 	lastop->setNext(proj);
 
 	return {scan, proj};
@@ -416,4 +928,8 @@ void Query::clear(){
 	predicates.clear();
 	filters.clear();
 	selections.clear();
+	temporaryHTs.clear();
+	temporaryBTs.clear();
+	temporaryAggregates.clear();
+	empty = false;
 }
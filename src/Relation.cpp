@@ -5,9 +5,27 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <unistd.h>
+#include <omp.h>
 
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
 
-Relation::Relation(const char *fname){
+
+// memory of minimized column, accounted against the memory budget
+static uint64_t columnBytes(const column_t &col, uint64_t size){
+	uint64_t bytes = col.dictionary_size*sizeof(uint64_t);
+	switch(col.data.index()){
+		case 0: /* mmap'ed relation file */ break;
+		case 1: bytes += size*sizeof(uint32_t); break;
+		case 2: bytes += size*sizeof(uint16_t); break;
+		case 3: bytes += size*sizeof(uint8_t); break;
+		case 4: bytes += bitpacked_t::numberOfWords(size, std::get<bitpacked_t>(col.data).bits)*sizeof(uint64_t); break;
+	}
+	return bytes;
+}
+
+Relation::Relation(const char *fname) : fname(fname) {
 	int fd = open(fname, O_RDONLY);
 	if(fd == -1){
 		perror("failed to open relation");
@@ -26,112 +44,1202 @@ Relation::Relation(const char *fname){
 		exit(EXIT_FAILURE);
 	}
 	// map file into memory
-	mapped_addr = reinterpret_cast<char*>(mmap(nullptr, fsize, PROT_READ, MAP_PRIVATE, fd, 0));
+	int flags = MAP_PRIVATE;
+	if(prefault_policy == Prefault::Populate){
+		// kernel faults in all pages sequentially during mmap()
+		flags |= MAP_POPULATE;
+	}
+	mapped_addr = reinterpret_cast<char*>(mmap(nullptr, fsize, PROT_READ, flags, fd, 0));
 	if(mapped_addr == MAP_FAILED){
 		perror("failed to fstat file");
 		exit(EXIT_FAILURE);
 	}
+	if(hugepage_policy != HugePages::None){
+		// only effective if the kernel supports huge pages for read-only file mappings
+		madvise(mapped_addr, fsize, MADV_HUGEPAGE);
+	}
+	prefaultMapping(mapped_addr, fsize);
+	if(isRelationV2(mapped_addr, fsize)){
+		// columns are stored narrowed, used directly from the mapped file
+		const RelationHeader *header = reinterpret_cast<const RelationHeader*>(mapped_addr);
+		if(header->version != relation_version || fsize < sizeof(RelationHeader) + header->num_columns*sizeof(RelationColumn)){
+			fprintf(stderr, "relation file %s has unsupported version %lu\n", fname, header->version);
+			exit(EXIT_FAILURE);
+		}
+		size = capacity = header->size;
+		formats = reinterpret_cast<const RelationColumn*>(mapped_addr + sizeof(RelationHeader));
+		for(size_t i=0; i<header->num_columns; ++i){
+			const RelationColumn &format = formats[i];
+			char *data = mapped_addr + format.offset;
+			if(format.offset + size*format.width/8 > fsize){
+				fprintf(stderr, "relation file %s is truncated\n", fname);
+				exit(EXIT_FAILURE);
+			}
+			placeMapping(data, size*format.width/8);
+			switch(format.width){
+				case 64: columns.push_back({reinterpret_cast<uint64_t*>(data), format.base}); break;
+				case 32: columns.push_back({reinterpret_cast<uint32_t*>(data), format.base}); break;
+				case 16: columns.push_back({reinterpret_cast<uint16_t*>(data), format.base}); break;
+				case  8: columns.push_back({reinterpret_cast<uint8_t*>(data), format.base}); break;
+				default:
+					fprintf(stderr, "relation file %s: column %lu has unsupported width %lu\n", fname, i, format.width);
+					exit(EXIT_FAILURE);
+			}
+		}
+		close(fd);
+		return;
+	}
 	// read header
 	char *addr = mapped_addr;
-	size = *reinterpret_cast<uint64_t*>(addr);
+	size = capacity = *reinterpret_cast<uint64_t*>(addr);
 	addr += sizeof(uint64_t);
 	size_t num_columns = *reinterpret_cast<size_t*>(addr);
 	addr += sizeof(size_t);
 	for(size_t i=0; i<num_columns; ++i){
 		// initially 64-bit values
-		columns.emplace_back(reinterpret_cast<uint64_t*>(addr));
+		placeMapping(addr, size*sizeof(uint64_t));
+		columns.push_back({reinterpret_cast<uint64_t*>(addr)});
 		addr += size*sizeof(uint64_t);
 	}
 	// close file, undo open(), file still open because of mmap()
 	close(fd);
 }
 
+// narrowed copy made by minimize()
+static void freeColumn(const column_t &col, uint64_t size){
+	releaseMemory(columnBytes(col, size));
+	freeMemory(col.dictionary, col.dictionary_size*sizeof(uint64_t));
+	switch(col.data.index()){
+		case 0: /* nothing to do, memory was mmap'ed */ break;
+		case 1: freeMemory(std::get<uint32_t*>(col.data), size*sizeof(uint32_t)); break;
+		case 2: freeMemory(std::get<uint16_t*>(col.data), size*sizeof(uint16_t)); break;
+		case 3: freeMemory(std::get<uint8_t*>(col.data), size*sizeof(uint8_t)); break;
+		case 4: {
+			const bitpacked_t &packed = std::get<bitpacked_t>(col.data);
+			freeMemory(packed.words, bitpacked_t::numberOfWords(size, packed.bits)*sizeof(uint64_t));
+			break;
+		}
+	}
+}
+
+// version 2 columns are mapped from the relation file, unless minimize() encoded them with a dictionary or bit-packed them
+static bool ownedColumn(const column_t &col, bool mapped){
+	return !mapped || col.dictionary || col.data.index() == 4;
+}
+
+// bits per stored value, 0 if values are not stored as offsets to base
+static uint64_t storedWidth(const column_t &col){
+	if(col.dictionary) return 0;
+	switch(col.data.index()){
+		case 0: return 64;
+		case 1: return 32;
+		case 2: return 16;
+		case 3: return 8;
+		default: return 0;
+	}
+}
+
+// growable copy made by append(), always offsets to base
+static void freeAppendedColumn(const column_t &col, uint64_t capacity){
+	const uint64_t bytes = capacity*storedWidth(col)/8;
+	releaseMemory(bytes);
+	std::visit([bytes](auto data){
+		if constexpr(!std::is_same_v<decltype(data), bitpacked_t>){
+			freeMemory(data, bytes);
+		}
+	}, col.data);
+}
+
 Relation::~Relation(){
 	munmap(mapped_addr, fsize);
+	for(size_t i=0; indexes && i<getNumberOfColumns()*INDEX_KINDS; ++i){
+		releaseMemory(indexes[i].bytes);
+	}
 
+	if(cache_addr){
+		// narrowed columns point into the mapped index cache
+		munmap(cache_addr, cache_size);
+		// columns, zone maps and statistics are copies after append()
+		if(!appended) return;
+	}
+	for(ZoneMap *zones : zonemaps){
+		freeMemory(zones, getNumberOfZones()*sizeof(ZoneMap));
+	}
+	for(ColumnStatistics *stat : statistics){
+		freeMemory(stat, sizeof(ColumnStatistics));
+	}
 	for(const auto &col : columns){
-		switch(col.index()){
-			case 0: /* nothing to do, memory was mmap'ed */ break;
-			case 1: delete[] std::get<uint32_t*>(col); break;
-			case 2: delete[] std::get<uint16_t*>(col); break;
+		if(appended){
+			freeAppendedColumn(col, capacity);
+		}else if(ownedColumn(col, formats)){
+			freeColumn(col, size);
 		}
 	}
 }
 
 Relation::Relation(Relation &&o){
+	fname = std::move(o.fname);
 	mapped_addr = o.mapped_addr;
 	fsize = o.fsize;
 	size = o.size;
+	capacity = o.capacity;
+	appended = o.appended;
 	columns = std::move(o.columns);
+	formats = o.formats;
+	infos = std::move(o.infos);
+	zonemaps = std::move(o.zonemaps);
+	statistics = std::move(o.statistics);
+	BTs = std::move(o.BTs);
 	HTs = std::move(o.HTs);
+	indexes = std::move(o.indexes);
+	cache_addr = o.cache_addr;
+	cache_size = o.cache_size;
+	page_nodes = std::move(o.page_nodes);
 	o.mapped_addr = nullptr;
 	o.fsize = 0;
 	o.size = 0;
+	o.cache_addr = nullptr;
+	o.cache_size = 0;
 }
 
-void Relation::stats(int column){
-#ifndef QUIET
-	auto t_start = std::chrono::high_resolution_clock::now();
-#endif
-	// min, max on column
-	uint64_t *col = std::get<uint64_t*>(columns[column]);
+// original values of a narrowed column
+template<typename T>
+struct OffsetValues{
+	const T *data;
+	uint64_t base;
+
+	uint64_t operator[](uint64_t idx) const{
+		return base + data[idx];
+	}
+};
+
+// original values of a dictionary-encoded column
+template<typename T>
+struct DictionaryValues{
+	const T *codes;
+	const uint64_t *dictionary;
+
+	uint64_t operator[](uint64_t idx) const{
+		return dictionary[codes[idx]];
+	}
+};
+
+// original values of a bit-packed column, padding word allows loading two words
+struct PackedValues{
+	bitpacked_t packed;
+	uint64_t base;
+
+	uint64_t operator[](uint64_t idx) const{
+		const uint64_t pos = idx * packed.bits;
+		const uint64_t shift = pos % 64;
+		uint64_t stored = packed.words[pos / 64] >> shift;
+		if(shift + packed.bits > 64){
+			stored |= packed.words[pos / 64 + 1] << (64 - shift);
+		}
+		return base + (stored & ((1ULL << packed.bits) - 1));
+	}
+};
+
+// calls f(values) with the original values of a column, narrowed copies are read through a decoding view
+// reading the narrowed copy instead of the 64-bit raw column saves memory traffic when building indexes
+template<typename F>
+void Relation::withValues(int column, F &&f) const{
+	const column_t &col = columns[column];
+	// const pointers, HashTable has a constructor wrapping mutable slots
+	if(col.dictionary || col.data.index() == 4){
+		if(!formats){
+			// expensive to decode, raw column is still in the version 1 file, append() removes both encodings
+			const uint64_t *raw = getRawColumn(column);
+			f(raw);
+		}else if(col.data.index() == 4){
+			f(PackedValues{std::get<bitpacked_t>(col.data), col.base});
+		}else if(col.data.index() == 3){
+			f(DictionaryValues<uint8_t>{std::get<uint8_t*>(col.data), col.dictionary});
+		}else{
+			f(DictionaryValues<uint16_t>{std::get<uint16_t*>(col.data), col.dictionary});
+		}
+		return;
+	}
+	switch(col.data.index()){
+		case 0:
+			if(col.base == 0){
+				const uint64_t *values = std::get<uint64_t*>(col.data);
+				f(values);
+			}else{
+				f(OffsetValues<uint64_t>{std::get<uint64_t*>(col.data), col.base});
+			}
+			break;
+		case 1: f(OffsetValues<uint32_t>{std::get<uint32_t*>(col.data), col.base}); break;
+		case 2: f(OffsetValues<uint16_t>{std::get<uint16_t*>(col.data), col.base}); break;
+		case 3: f(OffsetValues<uint8_t >{std::get<uint8_t* >(col.data), col.base}); break;
+	}
+}
+
+void Relation::minmax(int column){
+	// min, max on column, and on each morsel of it for the zone map
+	// distinct-count sketch in the same pass, while the morsel is in cache
+	ZoneMap *zones = (ZoneMap*)allocateMemory(getNumberOfZones()*sizeof(ZoneMap));
+	ColumnStatistics *stat = (ColumnStatistics*)allocateMemory(sizeof(ColumnStatistics));
+	stat->init(size);
 	uint64_t max=0, min=std::numeric_limits<uint64_t>::max();
+	const uint64_t zcount = getNumberOfZones();
+	withValues(column, [&](const auto &col){
+		// chunks of zones in parallel
+		#pragma omp parallel reduction(min:min) reduction(max:max) num_threads(index_build_threads)
+		{
+			uint8_t sketch[ColumnStatistics::registers] = {};
+			#pragma omp for schedule(static) nowait
+			for(uint64_t z=0; z<zcount; ++z){
+				const uint64_t begin = z*morsel_size, end = std::min((z+1)*morsel_size, size);
+				uint64_t zmax=0, zmin=std::numeric_limits<uint64_t>::max();
+				#pragma omp simd reduction(min:zmin) reduction(max:zmax)
+				for(uint64_t idx=begin; idx<end; ++idx){
+					const uint64_t val = col[idx];
+					zmin = std::min(zmin, val);
+					zmax = std::max(zmax, val);
+				}
+				for(uint64_t idx=begin; idx<end; ++idx){
+					ColumnStatistics::addToSketch(sketch, col[idx]);
+				}
+				zones[z] = {zmin, zmax};
+				if(min > zmin) min = zmin;
+				if(max < zmax) max = zmax;
+			}
+			#pragma omp critical
+			stat->mergeSketch(sketch);
+		}
+	});
+	if(formats){
+		// version 2 files know min, max and the number of distinct values
+		const RelationColumn &format = formats[column];
+		infos[column] = {format.min, format.max, format.distinct};
+	}else{
+		infos[column] = {min, max, 0};
+	}
+	zonemaps[column] = zones;
+	statistics[column] = stat;
+}
+
+void Relation::sketch(int column){
+	// histogram and heavy hitters on original values, sketch was filled by minmax()
+	withValues(column, [&](const auto &col){
+		statistics[column]->buildSample(col, infos[column].min, infos[column].max);
+	});
+}
+
+// inserts value into bitset bt, if any, counts values which were already contained
+struct BitsetHook{
+	BitsetTable *bt;
+	bool atomic;
+	uint64_t operator()(uint64_t val) const{
+		if(!bt) return 0;
+		return atomic ? !bt->insertAtomic(val) : !bt->insert(val);
+	}
+};
+
+// copy of column with smaller type, values stored as offset to base
+template<typename T, typename C>
+static T *narrow(const C &col, uint64_t size, uint64_t base, const BitsetHook &hook, uint64_t &duplicates){
+	T *newcol = (T*)allocateMemory(size*sizeof(T), false, Access::Sequential);
+	uint64_t dups=0;
+	#pragma omp parallel for schedule(static) reduction(+:dups) num_threads(index_build_threads)
 	for(uint64_t idx=0; idx<size; ++idx){
-		const auto val = col[idx];
-		if(min > val) min = val;
-		if(max < val) max = val;
+		newcol[idx] = col[idx] - base;
+		dups += hook(col[idx]);
 	}
-#ifndef QUIET
-	auto t_minmax = std::chrono::high_resolution_clock::now();
+	duplicates = dups;
+	return newcol;
+}
+
+#ifdef BITPACKCOL
+// pack values with arbitrary number of bits, values stored as offset to base
+template<typename C>
+static bitpacked_t pack(const C &col, uint64_t size, uint64_t base, uint64_t bits, const BitsetHook &hook, uint64_t &duplicates){
+	uint64_t *words = (uint64_t*)allocateMemory(bitpacked_t::numberOfWords(size, bits)*sizeof(uint64_t), true, Access::Sequential);
+	// blocks of 64 values start and end at word boundaries, threads never share a word
+	const uint64_t blocks = (size + 63) / 64;
+	uint64_t dups=0;
+	#pragma omp parallel for schedule(static) reduction(+:dups) num_threads(index_build_threads)
+	for(uint64_t block=0; block<blocks; ++block){
+		for(uint64_t idx=block*64, end=std::min(idx+64, size); idx<end; ++idx){
+			const uint64_t val = col[idx] - base;
+			const uint64_t pos = idx * bits;
+			const uint64_t shift = pos % 64;
+			words[pos / 64] |= val << shift;
+			if(shift + bits > 64){
+				// spans two words
+				words[pos / 64 + 1] |= val >> (64 - shift);
+			}
+			dups += hook(col[idx]);
+		}
+	}
+	duplicates = dups;
+	return {words, bits};
+}
+#endif
+
+#ifdef DICTIONARYCOL
+// maps values of a low-cardinality column to codes, order-preserving
+class Dictionary{
+private:
+	// open addressing with linear probing, never more than half full
+	std::vector<uint64_t> keys;
+	std::vector<uint64_t> codes;
+	std::vector<bool> used;
+	uint64_t mask;
+	uint64_t limit;
+	std::vector<uint64_t> values;
+
+	uint64_t slot(uint64_t key) const{
+		uint64_t pos = (key * 0x9E3779B97F4A7C15ULL) & mask;
+		while(used[pos] && keys[pos] != key){
+			pos = (pos + 1) & mask;
+		}
+		return pos;
+	}
+
+public:
+	Dictionary(uint64_t limit) : limit(limit) {
+		uint64_t capacity = 1;
+		while(capacity < 2*limit) capacity <<= 1;
+		keys.resize(capacity);
+		codes.resize(capacity);
+		used.resize(capacity, false);
+		mask = capacity - 1;
+		values.reserve(limit);
+	}
+
+	// collect distinct values, returns false if there are more than limit
+	template<typename C>
+	bool build(const C &col, uint64_t size){
+		for(uint64_t idx=0; idx<size; ++idx){
+			uint64_t pos = slot(col[idx]);
+			if(!used[pos]){
+				if(values.size() == limit) return false;
+				used[pos] = true;
+				keys[pos] = col[idx];
+				values.push_back(col[idx]);
+			}
+		}
+		// codes are positions in sorted dictionary, order of codes is order of values
+		std::sort(values.begin(), values.end());
+		for(uint64_t i=0; i<values.size(); ++i){
+			codes[slot(values[i])] = i;
+		}
+		return true;
+	}
+
+	template<typename T, typename C>
+	T *encode(const C &col, uint64_t size) const{
+		T *newcol = (T*)allocateMemory(size*sizeof(T), false, Access::Sequential);
+		#pragma omp parallel for schedule(static) num_threads(index_build_threads)
+		for(uint64_t idx=0; idx<size; ++idx){
+			newcol[idx] = codes[slot(col[idx])];
+		}
+		return newcol;
+	}
+
+	uint64_t *copyValues() const{
+		uint64_t *dictionary = (uint64_t*)allocateMemory(values.size()*sizeof(uint64_t));
+		std::copy(values.begin(), values.end(), dictionary);
+		return dictionary;
+	}
+	uint64_t getSize() const{
+		return values.size();
+	}
+};
 #endif
+
+// number of bits needed to represent value
+static uint64_t bitwidth(uint64_t value){
+	return value ? 64 - __builtin_clzl(value) : 0;
+}
+
+// smallest of the supported column types
+static uint64_t typewidth(uint64_t bits){
+	if(bits <= 8) return 8;
+	if(bits <= 16) return 16;
+	if(bits <= 32) return 32;
+	return 64;
+}
+
+bool Relation::minimize(int column, BitsetTable *bt){
 #ifdef MINIMIZECOL
+	// version 2 files store columns already narrowed, only dictionary and bit-packing can make them smaller
+	bool filled = false;
+	withValues(column, [&](const auto &col){
+		filled = minimize(column, col, bt);
+	});
+	return filled;
+#else
+	(void)column;
+	(void)bt;
+	return false;
+#endif
+}
+
+#ifdef MINIMIZECOL
+template<typename C>
+bool Relation::minimize(int column, const C &col, BitsetTable *bt){
 	// represent column with smaller type if possible
-	uint64_t bits = 64 - __builtin_clzl(max);
+	const uint64_t min = infos[column].min, max = infos[column].max;
+	uint64_t bits = bitwidth(max);
+	uint64_t bits2= bitwidth(max - min);
 #ifndef QUIET
-	uint64_t bits2= 64 - __builtin_clzl(max - min);
 	printf("r?c%i: %lu - %lu (min: %lu; max: %lu)\n", column, bits2, bits, min, max);
 #endif
-	if(bits <= 16){
-		uint16_t *newcol = new uint16_t[size];
-		for(uint64_t idx=0; idx<size; ++idx){
-			newcol[idx] = col[idx];
-		}
-		columns[column] = newcol;
-	}else if(bits <= 32){
-		uint32_t *newcol = new uint32_t[size];
-		for(uint64_t idx=0; idx<size; ++idx){
-			newcol[idx] = col[idx];
+	// frame of reference encoding if the value range needs a smaller type than the values
+	uint64_t base = 0;
+	if(typewidth(bits2) < typewidth(bits)){
+		base = min;
+		bits = bits2;
+	}
+#ifdef DICTIONARYCOL
+	// dictionary encoding if the number of distinct values needs a smaller type than the value range
+	if(bits > 8){
+		Dictionary dict(bits > 16 ? 1 << 16 : 1 << 8);
+		if(dict.build(col, size)){
+			const uint64_t codewidth = dict.getSize() <= (1 << 8) ? 1 : 2;
+			if(!reserveMemory(size*codewidth + dict.getSize()*sizeof(uint64_t))){
+#ifndef QUIET
+				printf("r?c%i: stays %lu-bit, memory budget exhausted\n", column, storedWidth(columns[column]));
+#endif
+				return false;
+			}
+			column_t &c = columns[column];
+			if(codewidth == 1){
+				c.data = dict.template encode<uint8_t>(col, size);
+			}else{
+				c.data = dict.template encode<uint16_t>(col, size);
+			}
+			c.base = 0;
+			c.dictionary = dict.copyValues();
+			c.dictionary_size = dict.getSize();
+#ifndef QUIET
+			printf("r?c%i: dictionary with %lu values\n", column, dict.getSize());
+#endif
+			// bitset is on codes, not on values
+			return false;
 		}
-		columns[column] = newcol;
-	} // stays at 64-bit values
+	}
+#endif
+	// narrowed copy has to fit into the memory budget, otherwise the column stays in the relation file
+	uint64_t bytes = size*typewidth(bits)/8;
+	bool packed = false;
+#ifdef BITPACKCOL
+	// pack if it saves at least a quarter of the smallest type
+	packed = bits*4 < typewidth(bits)*3 && bits > 8;
+	if(packed){
+		bytes = bitpacked_t::numberOfWords(size, bits)*sizeof(uint64_t);
+	}
 #endif
+	// nothing to gain if the stored type is already the smallest, always the case for version 2 columns
+	if(!packed && typewidth(bits) >= storedWidth(columns[column])){
+		return false;
+	}
+	if(!reserveMemory(bytes)){
 #ifndef QUIET
-	auto t_minimize = std::chrono::high_resolution_clock::now();
+		printf("r?c%i: stays %lu-bit, memory budget exhausted\n", column, storedWidth(columns[column]));
+#endif
+		return false;
+	}
+	// bitset filled while the values stream through for narrowing
+	const BitsetHook hook{bt, index_build_threads > 1};
+	uint64_t duplicates=0;
+#ifdef BITPACKCOL
+	if(packed){
+		columns[column] = {pack(col, size, base, bits, hook, duplicates), base};
+		if(bt) infos[column].distinct = size - duplicates;
+		return bt != nullptr;
+	}
+#endif
+	switch(typewidth(bits)){
+		case  8: columns[column] = {narrow<uint8_t >(col, size, base, hook, duplicates), base}; break;
+		case 16: columns[column] = {narrow<uint16_t>(col, size, base, hook, duplicates), base}; break;
+		case 32: columns[column] = {narrow<uint32_t>(col, size, base, hook, duplicates), base}; break;
+	}
+	if(bt) infos[column].distinct = size - duplicates;
+	return bt != nullptr;
+}
 #endif
+
+// calls f(min, max, keys) with the keys the indexes of a column are built on
+template<typename F>
+void Relation::withIndexKeys(int column, F &&f) const{
+	const column_t &col = columns[column];
+	auto [min, max] = getIndexDomain(column);
+	if(col.dictionary){
+		// dense domain of codes
+		if(col.data.index() == 3){
+			f(min, max, std::get<uint8_t*>(col.data));
+		}else{
+			f(min, max, std::get<uint16_t*>(col.data));
+		}
+	}else{
+		withValues(column, [&](const auto &values){
+			f(min, max, values);
+		});
+	}
+}
+
+void Relation::buildBT(int column, bitset_t &bt) const{
 	// precalc BitsetTable for column, in case we want to have a semijoin
-	BTs[column].init(min, max, col, size);
+	withIndexKeys(column, [&](uint64_t min, uint64_t max, const auto &keys){
+		if(isSparse(column)){
+			// set of distinct keys, bitset would be mostly empty
+			HTsu_t &set = bt.emplace<HTsu_t>(hashCapacity(size));
+			uint64_t distinct=0;
+			for(uint64_t i=0; i<size; ++i){
+				distinct += set.insert(keys[i], i);
+			}
+			infos[column].distinct = distinct;
+		}else{
+			infos[column].distinct = bt.emplace<BitsetTable>().init(min, max, keys, size, index_build_threads);
+		}
+	});
+}
+
+void Relation::buildHT(int column, hashtable_t &ht) const{
+	// uniqueness is detected while building the bitset
+	const bool unique = isUnique(column);
+	withIndexKeys(column, [&](uint64_t min, uint64_t max, const auto &keys){
+		if(isSparse(column)){
+			// precalc hash tables, array-based tables would be mostly empty
+			if(!unique){
+				ht.emplace<HTs_t>(keys, size);
+			}else{
+				ht.emplace<HTsu_t>(keys, size);
+			}
+		}else if(!unique){
+			// precalc MultiArrayTable
+			ht.emplace<HT_t>(min, max, keys, size, index_build_threads);
+		}else{
+			// precalc ArrayTable because it only contains unique elements
+			ht.emplace<HTu_t>(min, max, keys, size);
+		}
+	});
+}
+
+// domain of the keys of selected rows, zero if none
+template<typename C>
+static std::pair<uint64_t,uint64_t> keyRange(const C &keys, uint64_t count, unsigned threads){
+	if(count == 0) return {0, 0};
+	uint64_t max=0, min=std::numeric_limits<uint64_t>::max();
+	#pragma omp parallel for schedule(static) reduction(min:min) reduction(max:max) num_threads(threads)
+	for(uint64_t i=0; i<count; ++i){
+		min = std::min<uint64_t>(min, keys[i]);
+		max = std::max<uint64_t>(max, keys[i]);
+	}
+	return {min, max};
+}
+
+void Relation::buildFilteredBT(int column, const std::vector<uint64_t> &rows, bitset_t &bt, unsigned threads) const{
+	withIndexKeys(column, [&](uint64_t, uint64_t, const auto &keys){
+		const SelectedKeys<std::decay_t<decltype(keys)>> selected{keys, rows.data()};
+		const uint64_t count = rows.size();
+		// domain of the selected keys only, usually much smaller than the one of the column
+		const auto [min, max] = keyRange(selected, count, threads);
+		if(max - min >= count * max_domain_per_tuple){
+			HTsu_t &set = bt.emplace<HTsu_t>(hashCapacity(count));
+			for(uint64_t i=0; i<count; ++i){
+				set.insert(selected[i], rows[i]);
+			}
+		}else{
+			bt.emplace<BitsetTable>().init(min, max, selected, count, threads);
+		}
+	});
+}
+
+void Relation::buildFilteredHT(int column, const std::vector<uint64_t> &rows, hashtable_t &ht, unsigned threads) const{
+	// any subset of a unique column is unique
+	const bool unique = isUnique(column);
+	withIndexKeys(column, [&](uint64_t, uint64_t, const auto &keys){
+		const SelectedKeys<std::decay_t<decltype(keys)>> selected{keys, rows.data()};
+		const uint64_t count = rows.size();
+		const auto [min, max] = keyRange(selected, count, threads);
+		if(max - min >= count * max_domain_per_tuple){
+			if(!unique){
+				ht.emplace<HTs_t>(selected, count, rows.data());
+			}else{
+				ht.emplace<HTsu_t>(selected, count, rows.data());
+			}
+		}else if(!unique){
+			ht.emplace<HT_t>(min, max, selected, count, rows.data(), threads);
+		}else{
+			ht.emplace<HTu_t>(min, max, selected, count, rows.data());
+		}
+	});
+}
+
+// totals[groupOf[i]] += value(i) for all rows
+template<typename V>
+static void sumByGroup(std::vector<uint64_t> &totals, const std::vector<uint64_t> &groupOf, V &&value, unsigned threads){
+	const uint64_t count = groupOf.size(), groups = totals.size();
+	if(threads == 1){
+		for(uint64_t i=0; i<count; ++i){
+			totals[groupOf[i]] += value(i);
+		}
+	}else if(groups * threads <= count){
+		// few groups: partial totals per thread, each thread merges a slice of the groups
+		std::vector<uint64_t> partials(threads * groups, 0);
+		#pragma omp parallel num_threads(threads)
+		{
+			const uint64_t team = omp_get_num_threads(), t = omp_get_thread_num();
+			uint64_t *partial = partials.data() + t * groups;
+			#pragma omp for schedule(static)
+			for(uint64_t i=0; i<count; ++i){
+				partial[groupOf[i]] += value(i);
+			}
+			for(uint64_t g=groups*t/team, end=groups*(t+1)/team; g<end; ++g){
+				for(uint64_t th=0; th<team; ++th){
+					totals[g] += partials[th * groups + g];
+				}
+			}
+		}
+	}else{
+		// many groups: threads rarely hit the same group, atomic adds instead of copies of all groups
+		#pragma omp parallel for schedule(static) num_threads(threads)
+		for(uint64_t i=0; i<count; ++i){
+			__atomic_fetch_add(&totals[groupOf[i]], value(i), __ATOMIC_RELAXED);
+		}
+	}
+}
+
+void Relation::buildAggregate(int column, const std::vector<unsigned> &sumColumns, const std::vector<uint64_t> *rows, Aggregate &agg, unsigned threads) const{
+	const uint64_t count = rows ? rows->size() : size;
+	// group of each row
+	std::vector<uint64_t> groupOf(count);
+	withIndexKeys(column, [&](uint64_t, uint64_t, const auto &keys){
+		auto group = [&](const auto &selected){
+			const auto [min, max] = keyRange(selected, count, threads);
+			if(max - min >= count * max_domain_per_tuple){
+				// distinct keys of each contiguous chunk, in order of first occurrence
+				std::vector<std::vector<uint64_t>> firsts(threads);
+				#pragma omp parallel num_threads(threads)
+				{
+					const uint64_t team = omp_get_num_threads(), t = omp_get_thread_num();
+					const uint64_t begin = count * t / team, end = count * (t + 1) / team;
+					HTsu_t seen(hashCapacity(end - begin));
+					for(uint64_t i=begin; i<end; ++i){
+						if(seen.insert(selected[i], 0)){
+							firsts[t].push_back(selected[i]);
+						}
+					}
+				}
+				// groups numbered by first occurrence of the key, chunks are in row order
+				HTsu_t &groups = agg.groups.emplace<HTsu_t>(hashCapacity(count));
+				uint64_t ngroups=0;
+				for(const auto &keys : firsts){
+					for(uint64_t key : keys){
+						ngroups += groups.insert(key, ngroups);
+					}
+				}
+				#pragma omp parallel for schedule(static) num_threads(threads)
+				for(uint64_t i=0; i<count; ++i){
+					groupOf[i] = groups.lookup(selected[i]);
+				}
+				agg.counts.assign(ngroups, 0);
+				sumByGroup(agg.counts, groupOf, [](uint64_t){ return 1; }, threads);
+			}else{
+				// group is the position of the key in the domain
+				HTu_t &groups = agg.groups.emplace<HTu_t>(min, max);
+				#pragma omp parallel for schedule(static) num_threads(threads)
+				for(uint64_t i=0; i<count; ++i){
+					groupOf[i] = selected[i] - min;
+				}
+				agg.counts.assign(max - min + 1, 0);
+				sumByGroup(agg.counts, groupOf, [](uint64_t){ return 1; }, threads);
+				#pragma omp parallel for schedule(static) num_threads(threads)
+				for(uint64_t g=0; g<agg.counts.size(); ++g){
+					if(agg.counts[g]){
+						groups.insert(min + g, g);
+					}
+				}
+			}
+		};
+		if(rows){
+			group(SelectedKeys<std::decay_t<decltype(keys)>>{keys, rows->data()});
+		}else{
+			group(keys);
+		}
+	});
+	// sums of original values per group
+	agg.sums.assign(sumColumns.size(), std::vector<uint64_t>(agg.counts.size(), 0));
+	for(size_t c=0; c<sumColumns.size(); ++c){
+		withValues(sumColumns[c], [&](const auto &values){
+			sumByGroup(agg.sums[c], groupOf, [&](uint64_t i){ return values[rows ? (*rows)[i] : i]; }, threads);
+		});
+	}
+	agg.countColumn = {agg.counts.data()};
+	for(std::vector<uint64_t> &sum : agg.sums){
+		agg.sumColumns.push_back({sum.data()});
+	}
+}
+
+bool Relation::isUnique(int column) const{
+	// known once any bitset was built, also after the resident one was evicted
+	if(infos[column].distinct == 0){
+		// count distinct values with a temporary bitset, not accounted against the memory budget
+		bitset_t tmp;
+		buildBT(column, tmp);
+	}
+	return infos[column].distinct == size;
+}
+
+uint64_t Relation::estimateIndexBytes(int column, IndexKind kind) const{
+	const auto [min, max] = getIndexDomain(column);
+	const uint64_t word = sizeof(uint64_t);
+	if(kind == INDEX_BT){
+		if(isSparse(column)){
+			return 2 * hashCapacity(size) * word;
+		}
+		return ((max - min + 1) / 64 + 1) * word;
+	}
+	const bool unique = isUnique(column);
+	if(isSparse(column)){
+		return unique ? 2 * hashCapacity(size) * word : 3 * hashCapacity(size) * word + size * word;
+	}
+	return unique ? (max - min + 1) * word : (max - min + 2) * word + size * word;
+}
+
+// adds time since start to the accumulated time of phase, returns end of phase
+static std::chrono::high_resolution_clock::time_point phaseDone(PrecalcPhase phase, std::chrono::high_resolution_clock::time_point start){
+	auto now = std::chrono::high_resolution_clock::now();
+	precalc_time_ns[phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+	return now;
+}
+
+void Relation::stats(int column){
+	auto t_start = std::chrono::high_resolution_clock::now();
+	minmax(column);
+	auto t_minmax = phaseDone(PHASE_MINMAX, t_start);
+	sketch(column);
+	auto t_sketch = phaseDone(PHASE_SKETCH, t_minmax);
+	minimizeWithBitset(column);
+	auto t_minimize = phaseDone(PHASE_MINIMIZE, t_sketch);
+	// index phases are accounted by ensureIndex()
+	ensureIndex(column, INDEX_BT);
 #ifndef QUIET
 	auto t_bt = std::chrono::high_resolution_clock::now();
 #endif
-	//TODO: check uniqueness (with Bitset)
-	//HACK: assumes first column is unique
-	if(column!=0){
-		// precalc MultiArrayTable
-		HTs[column].emplace<HT_t>(min, max, col, size);
-	}else{
-		// precalc ArrayTable because it only contains unique elements
-		HTs[column].emplace<HTu_t>(min, max, col, size);
-	}
+	ensureIndex(column, INDEX_HT);
 
 #ifndef QUIET
 	auto t_ht = std::chrono::high_resolution_clock::now();
-	printf("column: %i; size: %lu\n  minmax: %12.2f us\nminimize: %12.2f us\n  bitset: %12.2f us\n      HT: %12.2f us\n   total: %12.2f us\n---\n",
+	printf("column: %i; size: %lu\n  minmax: %12.2f us\n  sketch: %12.2f us\nminimize: %12.2f us\n  bitset: %12.2f us\n      HT: %12.2f us\n   total: %12.2f us\n---\n",
 		column, size,
 		std::chrono::duration<double, std::micro>(t_minmax - t_start).count(),
-		std::chrono::duration<double, std::micro>( t_minimize - t_minmax ).count(),
+		std::chrono::duration<double, std::micro>( t_sketch - t_minmax ).count(),
+		std::chrono::duration<double, std::micro>( t_minimize - t_sketch ).count(),
 		std::chrono::duration<double, std::micro>( t_bt - t_minimize ).count(),
 		std::chrono::duration<double, std::micro>( t_ht - t_bt ).count(),
 		std::chrono::duration<double, std::micro>( t_ht - t_start).count()
 	);
+#else
+	(void)t_minimize;
 #endif
 }
+
+void Relation::stats_lazy(int column){
+	auto t_start = std::chrono::high_resolution_clock::now();
+	minmax(column);
+	auto t_minmax = phaseDone(PHASE_MINMAX, t_start);
+	sketch(column);
+	auto t_sketch = phaseDone(PHASE_SKETCH, t_minmax);
+	minimize(column);
+	phaseDone(PHASE_MINIMIZE, t_sketch);
+}
+
+// first byte of the morsel in the column
+static const void *morselAddress(const column_t &col, uint64_t morsel){
+	const uint64_t row = morsel * morsel_size;
+	switch(col.data.index()){
+		case 0: return std::get<uint64_t*>(col.data) + row;
+		case 1: return std::get<uint32_t*>(col.data) + row;
+		case 2: return std::get<uint16_t*>(col.data) + row;
+		case 3: return std::get<uint8_t*>(col.data) + row;
+		case 4: {
+			const bitpacked_t &packed = std::get<bitpacked_t>(col.data);
+			return packed.words + row * packed.bits / 64;
+		}
+	}
+	return nullptr;
+}
+
+void Relation::locatePages(){
+	page_nodes.clear();
+	if(numaNodes() < 2) return;
+	const uint64_t morsels = getNumberOfZones();
+	std::vector<const void*> pages(morsels);
+	std::vector<int> nodes(morsels);
+	page_nodes.resize(columns.size());
+	for(size_t c=0; c<columns.size(); ++c){
+		for(uint64_t m=0; m<morsels; ++m){
+			pages[m] = morselAddress(columns[c], m);
+		}
+		pageNodes(pages.data(), morsels, nodes.data());
+		page_nodes[c].assign(nodes.begin(), nodes.end());
+	}
+}
+
+uint64_t Relation::getMorselBytes(int column, uint64_t morsel) const{
+	const uint64_t rows = std::min(size - morsel * morsel_size, morsel_size);
+	const column_data_t &data = columns[column].data;
+	if(data.index() == 4){
+		return rows * std::get<bitpacked_t>(data).bits / 8;
+	}
+	// 8, 4, 2 or 1 byte per value
+	return rows * (sizeof(uint64_t) >> data.index());
+}
+
+// shared by all relations, only used when a thread has to wait for an index built by another thread
+static std::mutex index_mutex;
+static std::condition_variable index_cv;
+
+bool Relation::ensureIndex(int column, IndexKind kind) const{
+	IndexSlot &index = indexes[column*INDEX_KINDS + kind];
+	std::atomic<uint8_t> &state = index.state;
+	if(state.load(std::memory_order_acquire) == INDEX_READY) return true;
+	{
+		std::unique_lock<std::mutex> lock(index_mutex);
+		// append() replaces the columns the index is built on
+		index_cv.wait(lock, [this]{ return !appending; });
+		if(state.load(std::memory_order_acquire) == INDEX_BUILDING){
+			// somebody else builds it, wait until finished
+			index_cv.wait(lock, [&state]{ return state.load(std::memory_order_acquire) != INDEX_BUILDING; });
+			return state.load(std::memory_order_acquire) == INDEX_READY;
+		}
+		if(state.load(std::memory_order_acquire) == INDEX_READY) return true;
+		// we build it, if it fits into the memory budget
+		state.store(INDEX_BUILDING, std::memory_order_release);
+	}
+	const uint64_t bytes = estimateIndexBytes(column, kind);
+	const bool fits = reserveMemory(bytes);
+	if(fits){
+		index.bytes = bytes;
+		if(kind == INDEX_BT){
+			auto t_start = std::chrono::high_resolution_clock::now();
+			buildBT(column, BTs[column]);
+			phaseDone(PHASE_BITSET, t_start);
+		}else{
+			// uniqueness might need the bitset first, not accounted to the hash table
+			isUnique(column);
+			auto t_start = std::chrono::high_resolution_clock::now();
+			buildHT(column, HTs[column]);
+			phaseDone(PHASE_HT, t_start);
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(index_mutex);
+		state.store(fits ? INDEX_READY : INDEX_MISSING, std::memory_order_release);
+	}
+	index_cv.notify_all();
+	return fits;
+}
+
+void Relation::minimizeWithBitset(int column){
+	// fill the bitset in the same pass as narrowing the column, instead of reading the column again
+	// not with dictionaries, the bitset is built on codes which are unknown before minimize()
+#ifndef DICTIONARYCOL
+	IndexSlot &index = indexes[column*INDEX_KINDS + INDEX_BT];
+	uint8_t expected = INDEX_MISSING;
+	if(!isSparse(column) && index.state.compare_exchange_strong(expected, INDEX_BUILDING)){
+		const uint64_t bytes = estimateIndexBytes(column, INDEX_BT);
+		const bool fits = reserveMemory(bytes);
+		if(fits){
+			index.bytes = bytes;
+			BitsetTable &bt = BTs[column].emplace<BitsetTable>(infos[column].min, infos[column].max);
+			if(!minimize(column, &bt)){
+				// column was not narrowed, separate pass
+				auto t_start = std::chrono::high_resolution_clock::now();
+				buildBT(column, BTs[column]);
+				phaseDone(PHASE_BITSET, t_start);
+			}
+		}else{
+			minimize(column);
+		}
+		{
+			std::lock_guard<std::mutex> lock(index_mutex);
+			index.state.store(fits ? INDEX_READY : INDEX_MISSING, std::memory_order_release);
+		}
+		index_cv.notify_all();
+		return;
+	}
+#endif
+	minimize(column);
+}
+
+void Relation::evictIndex(int column, IndexKind kind){
+	IndexSlot &index = indexes[column*INDEX_KINDS + kind];
+	if(index.state.load(std::memory_order_acquire) != INDEX_READY) return;
+	// memory of tables is released by their destructor
+	if(kind == INDEX_BT){
+		BTs[column].emplace<std::monostate>();
+	}else{
+		HTs[column].emplace<std::monostate>();
+	}
+	releaseMemory(index.bytes);
+	index.bytes = 0;
+	index.state.store(INDEX_MISSING, std::memory_order_release);
+}
+
+// calls f(idx, value) with the original value of each of the first size tuples, for any representation
+template<typename F>
+static void decodeColumn(const column_t &col, uint64_t size, F &&f){
+	std::visit([&](auto data){
+		for(uint64_t idx=0; idx<size; ++idx){
+			uint64_t stored;
+			if constexpr(std::is_same_v<decltype(data), bitpacked_t>){
+				const uint64_t pos = idx * data.bits;
+				const uint64_t shift = pos % 64;
+				stored = data.words[pos / 64] >> shift;
+				if(shift + data.bits > 64){
+					stored |= data.words[pos / 64 + 1] << (64 - shift);
+				}
+				stored &= (1ULL << data.bits) - 1;
+			}else{
+				stored = data[idx];
+			}
+			f(idx, col.dictionary ? col.dictionary[stored] : col.base + stored);
+		}
+	}, col.data);
+}
+
+// growable copy of the first size tuples, stored as offsets to base with the given width
+static column_t reencode(const column_t &old, uint64_t size, uint64_t capacity, uint64_t width, uint64_t base){
+	column_t col;
+	col.base = base;
+	auto fill = [&](auto *data){
+		decodeColumn(old, size, [&](uint64_t idx, uint64_t value){
+			data[idx] = value - base;
+		});
+		col.data = data;
+	};
+	switch(width){
+		case  8: fill((uint8_t *)allocateMemory(capacity*sizeof(uint8_t ), false, Access::Sequential)); break;
+		case 16: fill((uint16_t*)allocateMemory(capacity*sizeof(uint16_t), false, Access::Sequential)); break;
+		case 32: fill((uint32_t*)allocateMemory(capacity*sizeof(uint32_t), false, Access::Sequential)); break;
+		default: fill((uint64_t*)allocateMemory(capacity*sizeof(uint64_t), false, Access::Sequential)); break;
+	}
+	// counted even if over budget, appended tuples have no other place
+	memory_used += capacity*width/8;
+	return col;
+}
+
+void Relation::appendColumn(int column, const uint64_t *tuples, uint64_t count, uint64_t first, uint64_t newcapacity){
+	const size_t num_columns = getNumberOfColumns();
+	column_t &col = columns[column];
+	uint64_t min = infos[column].min, max = infos[column].max;
+	for(uint64_t i=0; i<count; ++i){
+		const uint64_t value = tuples[i*num_columns + column];
+		if(min > value) min = value;
+		if(max < value) max = value;
+	}
+	// widen only if the current representation cannot hold the new values
+	uint64_t width = storedWidth(col), base = col.base;
+	const bool fits = width && base <= min && (width == 64 || bitwidth(max - base) <= width);
+	if(!fits){
+#ifdef MINIMIZECOL
+		// same choice as minimize(), dictionary and bit-packing are not maintained
+		width = typewidth(bitwidth(max));
+		base = 0;
+		if(typewidth(bitwidth(max - min)) < width){
+			width = typewidth(bitwidth(max - min));
+			base = min;
+		}
+#else
+		width = 64;
+		base = 0;
+#endif
+	}
+	if(!fits || !appended || newcapacity != capacity){
+		column_t newcol = reencode(col, first, newcapacity, width, base);
+		if(col.dictionary){
+			// indexes are on codes
+			evictIndex(column, INDEX_BT);
+			evictIndex(column, INDEX_HT);
+		}
+		if(appended){
+			freeAppendedColumn(col, capacity);
+		}else if(!cache_addr && ownedColumn(col, formats)){
+			freeColumn(col, first);
+		}
+		col = newcol;
+	}
+	std::visit([&](auto data){
+		if constexpr(!std::is_same_v<decltype(data), bitpacked_t>){
+			for(uint64_t i=0; i<count; ++i){
+				data[first + i] = tuples[i*num_columns + column] - base;
+			}
+		}
+	}, col.data);
+	infos[column].min = min;
+	infos[column].max = max;
+}
+
+void Relation::appendZones(int column, uint64_t first, bool owned){
+	const uint64_t oldzones = (first + morsel_size - 1) / morsel_size;
+	ZoneMap *zones = (ZoneMap*)allocateMemory(getNumberOfZones()*sizeof(ZoneMap));
+	// last zone might have been partial
+	const uint64_t keep = first / morsel_size;
+	std::copy(zonemaps[column], zonemaps[column] + keep, zones);
+	withValues(column, [&](const auto &col){
+		for(uint64_t z=keep, zcount=getNumberOfZones(); z<zcount; ++z){
+			const uint64_t end = std::min((z+1)*morsel_size, size);
+			uint64_t zmax=0, zmin=std::numeric_limits<uint64_t>::max();
+			for(uint64_t idx=z*morsel_size; idx<end; ++idx){
+				const uint64_t val = col[idx];
+				if(zmin > val) zmin = val;
+				if(zmax < val) zmax = val;
+			}
+			zones[z] = {zmin, zmax};
+		}
+		statistics[column]->append(col, first, size);
+	});
+	if(owned){
+		freeMemory(zonemaps[column], oldzones*sizeof(ZoneMap));
+	}
+	zonemaps[column] = zones;
+}
+
+void Relation::appendIndexes(int column, uint64_t first){
+	const uint64_t min = infos[column].min, max = infos[column].max;
+	const bool sparse = isSparse(column);
+	withValues(column, [&](const auto &keys){
+		if(isIndexResident(column, INDEX_BT)){
+			uint64_t distinct = infos[column].distinct;
+			bool evict = false;
+			std::visit([&](auto &bt){
+				using BT = std::decay_t<decltype(bt)>;
+				if constexpr(std::is_same_v<BT, BitsetTable>){
+					// array-based index would be mostly empty, rebuilt as hash table
+					if(sparse){
+						evict = true;
+						return;
+					}
+					if(min < bt.getMin() || max > bt.getMax()){
+						bt.grow(min, max);
+					}
+					for(uint64_t i=first; i<size; ++i){
+						distinct += bt.insert(keys[i]);
+					}
+				}else if constexpr(std::is_same_v<BT, HTsu_t>){
+					if(hashCapacity(distinct + size - first) > bt.getCapacity()){
+						bt.grow(hashCapacity(distinct + size - first));
+					}
+					for(uint64_t i=first; i<size; ++i){
+						distinct += bt.insert(keys[i], i);
+					}
+				}
+			}, BTs[column]);
+			if(evict){
+				evictIndex(column, INDEX_BT);
+				distinct = 0;
+			}
+			infos[column].distinct = distinct;
+		}else{
+			// unknown, isUnique() counts again
+			infos[column].distinct = 0;
+		}
+
+		if(isIndexResident(column, INDEX_HT)){
+			const bool unique = isUnique(column);
+			bool evict = false;
+			std::visit([&](auto &ht){
+				using HT = std::decay_t<decltype(ht)>;
+				if constexpr(std::is_same_v<HT, HT_t>){
+					if(sparse){
+						evict = true;
+						return;
+					}
+					ht.append(min, max, keys, first, size);
+				}else if constexpr(std::is_same_v<HT, HTu_t>){
+					// becomes MultiArrayTable on rebuild if no longer unique
+					if(sparse || !unique){
+						evict = true;
+						return;
+					}
+					if(min < ht.getMin() || max > ht.getMax()){
+						ht.grow(min, max);
+					}
+					for(uint64_t i=first; i<size; ++i){
+						ht.insert(keys[i], i);
+					}
+				}else if constexpr(std::is_same_v<HT, HTsu_t>){
+					if(!unique){
+						evict = true;
+						return;
+					}
+					if(hashCapacity(size) > ht.getCapacity()){
+						ht.grow(hashCapacity(size));
+					}
+					for(uint64_t i=first; i<size; ++i){
+						ht.insert(keys[i], i);
+					}
+				}else if constexpr(std::is_same_v<HT, HTs_t>){
+					// rows are grouped per slot, rebuilt on next use
+					evict = true;
+				}
+			}, HTs[column]);
+			if(evict){
+				evictIndex(column, INDEX_HT);
+			}
+		}
+	});
+	// account grown indexes against the budget, like columns regardless of the limit
+	for(int kind=0; kind<INDEX_KINDS; ++kind){
+		IndexSlot &index = indexes[column*INDEX_KINDS + kind];
+		if(index.state.load(std::memory_order_acquire) != INDEX_READY) continue;
+		const uint64_t bytes = estimateIndexBytes(column, (IndexKind)kind);
+		releaseMemory(index.bytes);
+		memory_used += bytes;
+		index.bytes = bytes;
+	}
+}
+
+void Relation::append(const uint64_t *tuples, uint64_t count){
+	if(count == 0) return;
+	const size_t num_columns = getNumberOfColumns();
+	{
+		// background builds read the columns which are replaced here, no new one starts until appending is done
+		std::unique_lock<std::mutex> lock(index_mutex);
+		index_cv.wait(lock, [&]{
+			for(size_t i=0; i<num_columns*INDEX_KINDS; ++i){
+				if(indexes[i].state.load(std::memory_order_acquire) == INDEX_BUILDING) return false;
+			}
+			return !appending;
+		});
+		appending = true;
+	}
+	// zone maps and statistics are mapped read-only from the index cache before the first append
+	const bool owned = appended || !cache_addr;
+	if(!owned){
+		for(size_t c=0; c<num_columns; ++c){
+			// indexes as well, rebuilt on next use
+			evictIndex(c, INDEX_BT);
+			evictIndex(c, INDEX_HT);
+			ColumnStatistics *stat = (ColumnStatistics*)allocateMemory(sizeof(ColumnStatistics));
+			*stat = *statistics[c];
+			statistics[c] = stat;
+		}
+	}
+
+	const uint64_t first = size;
+	// grow geometrically, batches are usually small compared to the relation
+	const uint64_t newcapacity = first + count > capacity ? std::max(first + count, 2*capacity) : capacity;
+	for(size_t c=0; c<num_columns; ++c){
+		appendColumn(c, tuples, count, first, newcapacity);
+	}
+	size = first + count;
+	capacity = newcapacity;
+	appended = true;
+	for(size_t c=0; c<num_columns; ++c){
+		appendZones(c, first, owned);
+		appendIndexes(c, first);
+	}
+	{
+		std::lock_guard<std::mutex> lock(index_mutex);
+		appending = false;
+	}
+	index_cv.notify_all();
+}
@@ -1,18 +1,36 @@
 #include <cstdio>
+#include <cstring>
 #include <vector>
+#include <string>
+#include <algorithm>
+#include <thread>
 
 #ifndef DISABLE_OPENMP
 #include <omp.h>
 #endif
+#ifdef MEASURE_TIME
+#include <sys/resource.h>
+#endif
 
 #include <coat/Function.h>
 #include <coat/ControlFlow.h>
 
 #include "Relation.h"
 #include "Query.h"
+#ifdef LAZY_INDEX
+#include "IndexBuilder.h"
+#endif
 #include "ScanOperator.h"
 #include "ProjectionOperator.h"
+#ifdef PLANCACHE
+#include "PlanCache.h"
+#endif
+
 
+#ifdef LAZY_INDEX
+// background builds of the workload indexes, paused while a query runs
+static IndexBuilder *index_builder=nullptr;
+#endif
 
 #ifdef MEASURE_TIME
 double prepare_time=0.0;
@@ -50,42 +68,190 @@ static std::vector<Relation> parseInit(const char *fname){
 	return relations;
 }
 
-static void precalc(std::vector<Relation> &relations){
-#ifndef DISABLE_OPENMP
-	// parallelize per column in relation as well
-	size_t work = 0;
+// returns relations which were precalculated and not mapped from index cache
+static std::vector<Relation*> precalc(std::vector<Relation> &relations){
+	// relations which need precalculation
+	std::vector<Relation*> pending;
 	for(auto &r : relations){
-		work += r.getNumberOfColumns();
-		r.stats_init();
+#ifdef INDEX_CACHE
+		// warm start, just map precalculated columns and indexes
+		if(r.loadIndexCache()) continue;
+#endif
+		pending.push_back(&r);
 	}
-#ifndef QUIET
-	printf("precalculating %lu indices, %i threads\n", work, omp_get_max_threads());
-#endif
-	size_t threads = omp_get_max_threads();
-	if(work < threads) threads = work; //TODO: in this case one should also disable parallel sort
-	#pragma omp parallel for schedule(static,1) num_threads(threads)
-	for(size_t i=0; i<work; ++i){
-		//HACK: a lot of sequential work to get to the right column/work item
-		size_t j = i;
-		for(auto &r : relations){
-			if(j < r.getNumberOfColumns()){
-				r.stats(j);
-				break;
-			}
-			j -= r.getNumberOfColumns();
+#ifndef DISABLE_OPENMP
+	// one work item per column, largest relations first, small columns fill the gaps at the end
+	struct PrecalcItem{
+		Relation *relation;
+		int column;
+	};
+	std::vector<PrecalcItem> items;
+	uint64_t total = 0;
+	for(Relation *r : pending){
+		r->stats_init();
+		for(size_t c=0; c<r->getNumberOfColumns(); ++c){
+			items.push_back({r, (int)c});
+			total += r->getNumberOfTuples();
 		}
 	}
+	std::stable_sort(items.begin(), items.end(), [](const PrecalcItem &a, const PrecalcItem &b){
+		return a.relation->getNumberOfTuples() > b.relation->getNumberOfTuples();
+	});
+	const size_t threads = omp_get_max_threads();
+#ifndef QUIET
+	printf("precalculating %lu indices, %lu threads\n", items.size(), threads);
+#endif
+	#pragma omp parallel for schedule(dynamic,1) num_threads(std::max<size_t>(1, std::min(threads, items.size())))
+	for(size_t i=0; i<items.size(); ++i){
+		const PrecalcItem &item = items[i];
+		// columns larger than their share of the work are split into chunks processed by several threads
+		const uint64_t tuples = item.relation->getNumberOfTuples();
+		index_build_threads = std::clamp<uint64_t>(total ? threads * tuples / total : 1, 1, threads);
+#ifdef LAZY_INDEX
+		item.relation->stats_lazy(item.column);
+#else
+		item.relation->stats(item.column);
+#endif
+	}
 #else
 	// precalculate sequentially
-	for(auto &r : relations){
-		r.stats_init();
-		for(size_t c=0; c<r.getNumberOfColumns(); ++c){
-			r.stats(c);
+	for(Relation *r : pending){
+		r->stats_init();
+		for(size_t c=0; c<r->getNumberOfColumns(); ++c){
+#ifdef LAZY_INDEX
+			r->stats_lazy(c);
+#else
+			r->stats(c);
+#endif
 		}
 	}
 #endif
+	return pending;
 }
 
+#ifdef LAZY_INDEX
+// find indexes the workload is going to use by planning every query, most used first
+static std::vector<IndexRequest> scanWorkload(const char *fname, const std::vector<Relation> &relations, const std::vector<Relation*> &pending){
+	// usage count per index, only for relations without ready indexes
+	std::vector<std::vector<unsigned>> usage(relations.size());
+	for(const Relation *r : pending){
+		usage[r - relations.data()].resize(r->getNumberOfColumns() * INDEX_KINDS, 0);
+	}
+
+	FILE *fd = fopen(fname, "r");
+	if(!fd){
+		perror("fopen failed");
+		exit(EXIT_FAILURE);
+	}
+	char *line=nullptr;
+	size_t len=0;
+	Query q;
+	ssize_t nread;
+	while((nread=getline(&line, &len, fd)) != -1){
+		// batches of tuples are not known yet, only their relations grow
+		if(*line == 'F' || *line == 'I') continue;
+		line[nread-1] = '\0';
+		q.parse(line);
+		q.rewrite(relations);
+		// no index is used by a query with a known empty result
+		if(q.empty){
+			q.clear();
+			continue;
+		}
+		// right side of a join predicate is probed through the index the plan picks,
+		// build pipelines and eager aggregation build their own tables
+		const std::vector<JoinPlan> steps = q.plan(relations);
+		for(size_t i=0; i<steps.size(); ++i){
+			const JoinPlan &step = steps[i];
+			const Predicate &p = q.predicates[i];
+			const unsigned relid = q.relationIds[p.right.relationId];
+			if(usage[relid].empty() || step.filtered) continue;
+			if(step.kind == JoinPlan::Join){
+				++usage[relid][p.right.columnId*INDEX_KINDS + INDEX_HT];
+			}else if(step.kind == JoinPlan::SemiJoin){
+				++usage[relid][p.right.columnId*INDEX_KINDS + INDEX_BT];
+			}
+		}
+		q.clear();
+	}
+	free(line);
+	fclose(fd);
+
+	std::vector<std::pair<unsigned,IndexRequest>> weighted;
+	for(size_t relid=0; relid<relations.size(); ++relid){
+		for(size_t i=0; i<usage[relid].size(); ++i){
+			if(usage[relid][i] > 0){
+				weighted.push_back({usage[relid][i], {&relations[relid], int(i / INDEX_KINDS), IndexKind(i % INDEX_KINDS)}});
+			}
+		}
+	}
+	// most used first, larger relations first as they take longer to build
+	std::stable_sort(weighted.begin(), weighted.end(), [](const auto &a, const auto &b){
+		if(a.first == b.first){
+			return a.second.relation->getNumberOfTuples() > b.second.relation->getNumberOfTuples();
+		}
+		return a.first > b.first;
+	});
+	std::vector<IndexRequest> requests;
+	requests.reserve(weighted.size());
+	for(const auto &w : weighted){
+		requests.push_back(w.second);
+	}
+	return requests;
+}
+#endif
+
+
+// between queries: make room for indexes which queries had to build temporarily,
+// by evicting resident indexes which were used less often
+static void rebalanceIndexes(std::vector<Relation> &relations){
+	struct Candidate{
+		Relation *relation;
+		int column;
+		IndexKind kind;
+		uint64_t uses;
+	};
+	std::vector<Candidate> resident, missed;
+	for(Relation &r : relations){
+		for(size_t c=0; c<r.getNumberOfColumns(); ++c){
+			for(int k=0; k<INDEX_KINDS; ++k){
+				const IndexKind kind = IndexKind(k);
+				const uint64_t uses = r.getIndexUses(c, kind);
+				if(r.isIndexResident(c, kind)){
+					// indexes mapped from the index cache do not count against the budget
+					if(r.getIndexBytes(c, kind) > 0){
+						resident.push_back({&r, int(c), kind, uses});
+					}
+				}else if(uses > 0){
+					missed.push_back({&r, int(c), kind, uses});
+				}
+			}
+		}
+	}
+	// most used missing index first, least used resident index is evicted first
+	std::sort(missed.begin(), missed.end(), [](const auto &a, const auto &b){ return a.uses > b.uses; });
+	std::sort(resident.begin(), resident.end(), [](const auto &a, const auto &b){ return a.uses < b.uses; });
+	size_t evicted=0;
+	for(const Candidate &m : missed){
+		const uint64_t needed = m.relation->estimateIndexBytes(m.column, m.kind);
+		const uint64_t used = memory_used.load();
+		uint64_t available = memory_budget > used ? memory_budget - used : 0;
+		size_t victims = evicted;
+		while(available < needed && victims < resident.size() && resident[victims].uses < m.uses){
+			available += resident[victims].relation->getIndexBytes(resident[victims].column, resident[victims].kind);
+			++victims;
+		}
+		if(available < needed) break;
+		for(; evicted<victims; ++evicted){
+			const Candidate &v = resident[evicted];
+			v.relation->evictIndex(v.column, v.kind);
+#ifndef QUIET
+			printf("evicted index %i of column %i (%lu uses)\n", v.kind, v.column, v.uses);
+#endif
+		}
+		// missing index is built on its next use
+	}
+}
 
 void printResult(uint64_t amount, const uint64_t *results, uint64_t rsize, FILE *fd_out){
 	if(amount != 0){
@@ -114,6 +280,37 @@ void printResult(ProjectionOperator *proj, FILE *fd_out){
 }
 
 
+// appends tuples to a relation, format: I relation|values of tuple|values of tuple...
+static void parseInsert(char *line, std::vector<Relation> &relations){
+	char *save;
+	const char *rel = strtok_r(line + 1, "|", &save);
+	const unsigned relid = strtoul(rel, nullptr, 10);
+	if(relid >= relations.size()){
+		fprintf(stderr, "insert into unknown relation %u\n", relid);
+		exit(EXIT_FAILURE);
+	}
+	Relation &relation = relations[relid];
+	const size_t num_columns = relation.getNumberOfColumns();
+	std::vector<uint64_t> tuples;
+	for(char *t = strtok_r(nullptr, "|", &save); t; t = strtok_r(nullptr, "|", &save)){
+		char *pos = t;
+		for(size_t c=0; c<num_columns; ++c){
+			char *end;
+			tuples.push_back(strtoul(pos, &end, 10));
+			if(end == pos){
+				fprintf(stderr, "tuple '%s' for relation %u needs %lu values\n", t, relid, num_columns);
+				exit(EXIT_FAILURE);
+			}
+			pos = end;
+		}
+	}
+	relation.append(tuples.data(), tuples.size() / num_columns);
+	relation.locatePages();
+#ifndef QUIET
+	printf("appended %lu tuples to r%u, now %lu tuples\n", tuples.size() / num_columns, relid, relation.getNumberOfTuples());
+#endif
+}
+
 using executeFunc = void (*)(const Query &q, ScanOperator *scan, ProjectionOperator *proj, FILE *fd_out, void *data, size_t query);
 
 void parseWork(const char *fname, std::vector<Relation> &relations, executeFunc execfn, void *data){
@@ -137,14 +334,19 @@ void parseWork(const char *fname, std::vector<Relation> &relations, executeFunc
 	size_t query=1;
 	while((nread=getline(&line, &len, fd)) != -1){
 		if(*line == 'F') continue;
+		// remove included newline
+		line[nread-1] = '\0';
+		if(*line == 'I'){
+			// no query runs now, the next one sees the new tuples
+			parseInsert(line, relations);
+			continue;
+		}
 #ifndef QUIET
-		printf("%lu: %s", query, line);
+		printf("%lu: %s\n", query, line);
 #endif
 #ifdef MEASURE_TIME
 		auto t_start = std::chrono::high_resolution_clock::now();
 #endif
-		// remove included newline
-		line[nread-1] = '\0';
 		// parse query string
 		q.parse(line);
 
@@ -165,6 +367,20 @@ void parseWork(const char *fname, std::vector<Relation> &relations, executeFunc
 #endif
 
 		q.rewrite(relations);
+		if(q.empty){
+			// result is known without executing the query, no pipeline and no code generation
+			printResult(0, nullptr, q.selections.size(), fd_out);
+#ifdef MEASURE_TIME
+			prepare_time += std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - t_start).count();
+#endif
+			q.clear();
+			++query;
+			continue;
+		}
+#ifdef LAZY_INDEX
+		// query-time builds and the morsels of the query use all cores
+		if(index_builder) index_builder->pause();
+#endif
 		auto [scan,proj] = q.constructPipeline(relations);
 
 #ifdef MEASURE_TIME
@@ -175,6 +391,13 @@ void parseWork(const char *fname, std::vector<Relation> &relations, executeFunc
 
 		// deallocate pipeline
 		delete scan;
+#ifdef LAZY_INDEX
+		if(index_builder) index_builder->resume();
+#endif
+		if(memory_budget){
+			// no index is in use now
+			rebalanceIndexes(relations);
+		}
 #ifdef MEASURE_TIME
 		auto t_end = std::chrono::high_resolution_clock::now();
 #ifndef QUIET
@@ -222,14 +445,26 @@ void tupleByTuple(const Query &q, ScanOperator *scan, ProjectionOperator *proj,
 }
 
 #ifdef MORSELS
+// bytes of scanned columns read by workers on each NUMA node,
+// local if the kernel placed the pages on the node the worker was running on
+static std::atomic<uint64_t> numa_local_bytes[max_numa_nodes];
+static std::atomic<uint64_t> numa_remote_bytes[max_numa_nodes];
+
 // returns amount, writes to res
-uint64_t morsel_execution(codegen_func_type fnptr, uint64_t tuples, uint64_t *res, size_t rsize){
+uint64_t morsel_execution(codegen_func_type fnptr, const ScanOperator *scan, uint64_t *res, size_t rsize){
+	const uint64_t tuples = scan->getTuples();
 	uint64_t amount = 0;
 	for(size_t i=0; i<rsize; ++i){
 		res[i] = 0;
 	}
-	const uint64_t morsel_size = 1024;
-	const uint64_t morsel_count = (tuples / morsel_size) +1;
+	const uint64_t morsel_count = (tuples + morsel_size - 1) / morsel_size;
+	// one contiguous range of morsels per node, same proportional split as partitioned columns in placeMemory()
+	// column parts are rounded to huge pages, morsels next to a boundary may lie on the neighbouring node
+	const unsigned nodes = numa_policy == NumaPolicy::Partition ? numaNodes() : 1;
+	std::atomic<uint64_t> next[max_numa_nodes];
+	for(unsigned node=0; node<nodes; ++node){
+		next[node] = partitionBegin(node, nodes, morsel_count);
+	}
 	#pragma omp parallel
 	{
 		uint64_t privres[rsize];
@@ -238,20 +473,62 @@ uint64_t morsel_execution(codegen_func_type fnptr, uint64_t tuples, uint64_t *re
 			privaggr[i] = 0;
 		}
 		uint64_t privcollectedamount=0;
-		#pragma omp for schedule(dynamic,1)
-		for(uint64_t m=0; m<morsel_count; m++){
-			uint64_t begin = m * morsel_size;
-			uint64_t end = begin + morsel_size;
-			if(end > tuples){
-				// last one, gets the rest, that way we don't have to care about rounding
-				end = tuples;
+		uint64_t privlocal[max_numa_nodes]={}, privremote[max_numa_nodes]={};
+		const Relation &relation = scan->getRelation();
+		const bool numa = numaNodes() > 1;
+		// workers are split over the nodes like the morsels, and bound to the cores of their node
+		unsigned home = 0;
+		if(nodes > 1){
+			home = omp_get_thread_num() * nodes / omp_get_num_threads();
+			static thread_local int pinned = -1;
+			if(pinned != (int)home && pinToNode(home)){
+				pinned = home;
 			}
-			// execute
-			uint64_t privamount = fnptr(begin, end, privres);
-			for(size_t i=0; i<rsize; ++i){
-				privaggr[i] += privres[i];
+			if(pinned != (int)home){
+				// cores of the node unknown, take morsels of the node the thread happens to run on
+				home = currentNumaNode() % nodes;
+			}
+		}
+		// morsels of own node first, then steal from the other nodes
+		for(unsigned n=0; n<nodes; ++n){
+			const unsigned node = (home + n) % nodes;
+			const uint64_t range_end = partitionBegin(node + 1, nodes, morsel_count);
+			for(uint64_t m=next[node]++; m<range_end; m=next[node]++){
+				uint64_t begin = m * morsel_size;
+				uint64_t end = begin + morsel_size;
+				if(end > tuples){
+					// last one, gets the rest, that way we don't have to care about rounding
+					end = tuples;
+				}
+				// zone maps rule out all tuples
+				if(scan->skipMorsel(m)){
+					continue;
+				}
+				// execute
+				uint64_t privamount = fnptr(begin, end, privres);
+				for(size_t i=0; i<rsize; ++i){
+					privaggr[i] += privres[i];
+				}
+				privcollectedamount += privamount;
+				if(numa){
+					// node the worker actually ran on, against the node of the pages it read
+					const unsigned cpu_node = currentNumaNode();
+					for(unsigned c : scan->getColumns()){
+						const uint64_t bytes = relation.getMorselBytes(c, m);
+						if(relation.getPageNode(c, m) == cpu_node){
+							privlocal[cpu_node] += bytes;
+						}else{
+							privremote[cpu_node] += bytes;
+						}
+					}
+				}
+			}
+		}
+		if(numa){
+			for(unsigned node=0; node<numaNodes(); ++node){
+				numa_local_bytes[node] += privlocal[node];
+				numa_remote_bytes[node] += privremote[node];
 			}
-			privcollectedamount += privamount;
 		}
 
 		#pragma omp critical
@@ -264,6 +541,51 @@ uint64_t morsel_execution(codegen_func_type fnptr, uint64_t tuples, uint64_t *re
 	}
 	return amount;
 }
+#else
+// returns amount, writes to res
+// one call of the generated function per run of consecutive morsels not ruled out by the zone maps
+uint64_t sequential_execution(codegen_func_type fnptr, const ScanOperator *scan, uint64_t *res, size_t rsize){
+	const uint64_t tuples = scan->getTuples();
+	const uint64_t morsel_count = scan->getMorsels();
+	uint64_t amount = 0;
+	for(size_t i=0; i<rsize; ++i){
+		res[i] = 0;
+	}
+	uint64_t runres[rsize];
+	for(uint64_t m=0; m<morsel_count; ){
+		if(scan->skipMorsel(m)){
+			++m;
+			continue;
+		}
+		const uint64_t first = m;
+		while(m < morsel_count && !scan->skipMorsel(m)){
+			++m;
+		}
+		amount += fnptr(first * morsel_size, std::min(m * morsel_size, tuples), runres);
+		for(size_t i=0; i<rsize; ++i){
+			res[i] += runres[i];
+		}
+	}
+	return amount;
+}
+#endif
+
+#ifdef PLANCACHE
+static PlanCache plan_cache;
+
+static codegen_func_type cachedPlan(const std::string &key, const ParamBlock &params){
+	codegen_func_type fnptr = plan_cache.lookup(key, params);
+#ifndef QUIET
+	if(fnptr) puts("plan cache hit");
+#endif
+	return fnptr;
+}
+static void cachePlan(std::string &&key, codegen_func_type fnptr, ParamBlock &params){
+	plan_cache.insert(std::move(key), fnptr, params);
+}
+#else
+static codegen_func_type cachedPlan(const std::string&, const ParamBlock&){ return nullptr; }
+static void cachePlan(std::string&&, codegen_func_type, ParamBlock&){}
 #endif
 
 void codegenAsmjit(
@@ -280,33 +602,39 @@ void codegenAsmjit(
 #ifdef MEASURE_TIME
 	auto t_start = std::chrono::high_resolution_clock::now();
 #endif
+	std::string key;
+	ParamBlock params;
+	scan->bind(params, key);
+	codegen_func_type fnptr = cachedPlan(key, params);
+	if(!fnptr){
 #ifdef PROFILING
-	char buf[8]={};
-	snprintf(buf, sizeof(buf), "q%lu", query);
-	coat::Function<coat::runtimeasmjit,codegen_func_type> fn(*asmrt, buf);
+		char buf[8]={};
+		snprintf(buf, sizeof(buf), "q%lu", query);
+		coat::Function<coat::runtimeasmjit,codegen_func_type> fn(*asmrt, buf);
 #else
-	coat::Function<coat::runtimeasmjit,codegen_func_type> fn(*asmrt);
+		coat::Function<coat::runtimeasmjit,codegen_func_type> fn(*asmrt);
 #endif
-	{
-		CodegenContext ctx(fn, q.relationIds.size(), q.selections.size());
-		scan->codegen(fn, ctx);
-		proj->codegen_save(fn, ctx);
-		coat::ret(fn, ctx.amount);
+		{
+			CodegenContext ctx(fn, params, q.relationIds.size(), q.selections.size());
+			scan->codegen(fn, ctx);
+			proj->codegen_save(fn, ctx);
+			coat::ret(fn, ctx.amount);
+		}
+		// finalize function
+		fnptr = fn.finalize();
+		cachePlan(std::move(key), fnptr, params);
 	}
-	// finalize function
-	codegen_func_type fnptr = fn.finalize();
 #ifdef MEASURE_TIME
 	auto t_compile = std::chrono::high_resolution_clock::now();
 #endif
 
 	const size_t rsize = q.selections.size();
 	uint64_t res[rsize];
-	const uint64_t tuples = scan->getTuples();
 #ifdef MORSELS
-	uint64_t amount = morsel_execution(fnptr, tuples, res, rsize);
+	uint64_t amount = morsel_execution(fnptr, scan, res, rsize);
 #else
-	// execute generated function
-	uint64_t amount = fnptr(0, tuples, res);
+	// execute generated function, skipping morsels like the morsel-driven execution
+	uint64_t amount = sequential_execution(fnptr, scan, res, rsize);
 #endif
 
 #ifdef MEASURE_TIME
@@ -329,36 +657,42 @@ void codegenLLVMjit(const Query &q, ScanOperator *scan, ProjectionOperator *proj
 #ifdef MEASURE_TIME
 	auto t_start = std::chrono::high_resolution_clock::now();
 #endif
-	coat::Function<coat::runtimellvmjit,codegen_func_type> fn(*llvmrt);
-	{
-		CodegenContext ctx(fn, q.relationIds.size(), q.selections.size());
-		scan->codegen(fn, ctx);
-		proj->codegen_save(fn, ctx);
-		coat::ret(fn, ctx.amount);
-	}
-	llvmrt->print("last.ll");
-	if(!llvmrt->verifyFunctions()){
-		puts("verification failed. aborting.");
-		exit(EXIT_FAILURE); //FIXME: better error handling
-	}
-	if(llvmrt->getOptLevel() > 0){
-		llvmrt->optimize();
-		llvmrt->print("last_opt.ll");
-	}
-	// finalize function
-	codegen_func_type fnptr = fn.finalize();
+	std::string key;
+	ParamBlock params;
+	scan->bind(params, key);
+	codegen_func_type fnptr = cachedPlan(key, params);
+	if(!fnptr){
+		coat::Function<coat::runtimellvmjit,codegen_func_type> fn(*llvmrt);
+		{
+			CodegenContext ctx(fn, params, q.relationIds.size(), q.selections.size());
+			scan->codegen(fn, ctx);
+			proj->codegen_save(fn, ctx);
+			coat::ret(fn, ctx.amount);
+		}
+		llvmrt->print("last.ll");
+		if(!llvmrt->verifyFunctions()){
+			puts("verification failed. aborting.");
+			exit(EXIT_FAILURE); //FIXME: better error handling
+		}
+		if(llvmrt->getOptLevel() > 0){
+			llvmrt->optimize();
+			llvmrt->print("last_opt.ll");
+		}
+		// finalize function
+		fnptr = fn.finalize();
+		cachePlan(std::move(key), fnptr, params);
+	}
 #ifdef MEASURE_TIME
 	auto t_compile = std::chrono::high_resolution_clock::now();
 #endif
 
 	const size_t rsize = q.selections.size();
 	uint64_t res[rsize];
-	const uint64_t tuples = scan->getTuples();
 #ifdef MORSELS
-	uint64_t amount = morsel_execution(fnptr, tuples, res, rsize);
+	uint64_t amount = morsel_execution(fnptr, scan, res, rsize);
 #else
-	// execute generated function
-	uint64_t amount = fnptr(0, tuples, res);
+	// execute generated function, skipping morsels like the morsel-driven execution
+	uint64_t amount = sequential_execution(fnptr, scan, res, rsize);
 #endif
 
 #ifdef MEASURE_TIME
@@ -378,11 +712,83 @@ void codegenLLVMjit(const Query &q, ScanOperator *scan, ProjectionOperator *proj
 }
 
 
+#ifdef MEASURE_TIME
+// page faults of the process so far
+static std::pair<long,long> pageFaults(){
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return {usage.ru_minflt, usage.ru_majflt};
+}
+#endif
+
+// optional settings after the positional arguments
+static bool parseOption(const char *arg){
+	if(strncmp(arg, "--hugepages=", 12) == 0){
+		const char *v = arg + 12;
+		if(strcmp(v, "none") == 0){
+			hugepage_policy = HugePages::None;
+		}else if(strcmp(v, "thp") == 0){
+			hugepage_policy = HugePages::Transparent;
+		}else if(strcmp(v, "explicit") == 0){
+			hugepage_policy = HugePages::Explicit;
+		}else{
+			return false;
+		}
+	}else if(strncmp(arg, "--prefault=", 11) == 0){
+		const char *v = arg + 11;
+		if(strcmp(v, "none") == 0){
+			prefault_policy = Prefault::None;
+		}else if(strcmp(v, "populate") == 0){
+			prefault_policy = Prefault::Populate;
+		}else if(strcmp(v, "parallel") == 0){
+			prefault_policy = Prefault::Parallel;
+		}else{
+			return false;
+		}
+	}else if(strncmp(arg, "--numa=", 7) == 0){
+		const char *v = arg + 7;
+		if(strcmp(v, "none") == 0){
+			numa_policy = NumaPolicy::None;
+		}else if(strcmp(v, "interleave") == 0){
+			numa_policy = NumaPolicy::Interleave;
+		}else if(strcmp(v, "partition") == 0){
+			numa_policy = NumaPolicy::Partition;
+		}else{
+			return false;
+		}
+	}else if(strncmp(arg, "--memory-budget=", 16) == 0){
+		// bytes for narrowed columns and indexes, optional suffix k, m or g
+		char *end;
+		memory_budget = strtoull(arg + 16, &end, 10);
+		if(end == arg + 16){
+			return false;
+		}
+		switch(*end){
+			case 'k': memory_budget <<= 10; ++end; break;
+			case 'm': memory_budget <<= 20; ++end; break;
+			case 'g': memory_budget <<= 30; ++end; break;
+		}
+		if(*end != '\0'){
+			return false;
+		}
+	}else{
+		return false;
+	}
+	return true;
+}
+
 int main(int argc, char *argv[]){
 	if(argc < 4){
-		puts("./program -[t|a|l] init work");
+		puts("./program -[t|a|l] init work [--hugepages=none|thp|explicit] [--prefault=none|populate|parallel] [--numa=none|interleave|partition] [--memory-budget=bytes[k|m|g]]");
 		return -1;
 	}
+	// has to be set before anything is allocated
+	for(int i=4; i<argc; ++i){
+		if(!parseOption(argv[i])){
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return -1;
+		}
+	}
 
 #ifndef DISABLE_OPENMP
 	// setting for OpenMP
@@ -393,9 +799,33 @@ int main(int argc, char *argv[]){
 	auto t_start = std::chrono::high_resolution_clock::now();
 
 	std::vector<Relation> relations = parseInit(argv[2]);
-	precalc(relations);
+#ifdef MEASURE_TIME
+	auto t_load = std::chrono::high_resolution_clock::now();
+#endif
+	std::vector<Relation*> precalculated = precalc(relations);
+	// columns are in place now, placement of their pages is known for the accounting of memory traffic
+	for(Relation &r : relations){
+		r.locatePages();
+	}
+	// indexes and tables built by the query thread use all threads, like the morsels of the pipelines
+	index_build_threads = omp_get_max_threads();
+#ifdef LAZY_INDEX
+	// build indexes needed by the workload in the background, queries start right away
+	IndexBuilder builder(scanWorkload(argv[3], relations, precalculated), std::thread::hardware_concurrency());
+	index_builder = &builder;
+#ifndef QUIET
+	printf("building %lu indices in background\n", builder.getNumberOfRequests());
+#endif
+#elif defined(INDEX_CACHE)
+	for(Relation *r : precalculated){
+		r->storeIndexCache();
+	}
+#endif
 
 	auto t_init = std::chrono::high_resolution_clock::now();
+#ifdef MEASURE_TIME
+	auto faults_init = pageFaults();
+#endif
 
 	// init JIT engines
 #ifdef ENABLE_ASMJIT
@@ -430,11 +860,23 @@ int main(int argc, char *argv[]){
 	}
 
 	auto t_end = std::chrono::high_resolution_clock::now();
+#ifdef MEASURE_TIME
+	auto faults_end = pageFaults();
+#endif
 	printf(" init: %12.2f us\n work: %12.2f us\ntotal: %12.2f us\n",
 		std::chrono::duration<double, std::micro>(t_init - t_start).count(),
 		std::chrono::duration<double, std::micro>( t_end - t_init ).count(),
 		std::chrono::duration<double, std::micro>( t_end - t_start).count()
 	);
+#ifdef LAZY_INDEX
+	builder.wait();
+	printf("index: %12.2f us (%lu indices in background)\n", builder.getBuildTime(), builder.getNumberOfRequests());
+#ifdef INDEX_CACHE
+	for(Relation *r : precalculated){
+		r->storeIndexCache();
+	}
+#endif
+#endif
 
 #ifdef MEASURE_TIME
 	printf("\nbreakdown of time working on queries from query preparation, compilation latency to execution time\n"
@@ -442,6 +884,34 @@ int main(int argc, char *argv[]){
 			"prepare: %12.2f us\ncompile: %12.2f us\nexecute: %12.2f us\n",
 		prepare_time, compilation_time, exec_time
 	);
+#ifdef PLANCACHE
+	if(plan_cache.getHits() + plan_cache.getMisses()){
+		printf("plan cache: %lu hits, %lu misses (%.1f%% hit rate, %lu shapes)\n",
+			plan_cache.getHits(), plan_cache.getMisses(),
+			100.0 * plan_cache.getHits() / (plan_cache.getHits() + plan_cache.getMisses()), plan_cache.getNumberOfShapes()
+		);
+	}
+#endif
+	printf("\nmemory policy, huge pages: %s; prefault: %s\n"
+			"   load: %12.2f us (mapping relations, including prefault)\n"
+			" faults: %12ld minor %12ld major during init\n"
+			"         %12ld minor %12ld major during work\n",
+		toString(hugepage_policy), toString(prefault_policy),
+		std::chrono::duration<double, std::micro>(t_load - t_start).count(),
+		faults_init.first, faults_init.second,
+		faults_end.first - faults_init.first, faults_end.second - faults_init.second
+	);
+	printf(" memory: %12lu bytes of columns and indexes, budget: %lu bytes\n", memory_used.load(), memory_budget);
+	printf("\nprecalculation phases, accumulated over all columns\n");
+	for(int phase=0; phase<PRECALC_PHASES; ++phase){
+		printf("%8s: %12.2f us\n", toString((PrecalcPhase)phase), precalc_time_ns[phase].load() / 1000.0);
+	}
+#ifdef MORSELS
+	printf("\nnuma policy: %s; %u nodes\n", toString(numa_policy), numaNodes());
+	for(unsigned node=0; node<numaNodes(); ++node){
+		printf("   node %u: %12lu local %12lu remote bytes scanned\n", node, numa_local_bytes[node].load(), numa_remote_bytes[node].load());
+	}
+#endif
 #endif
 
 	return 0;
@@ -0,0 +1,112 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include <omp.h>
+
+#include "Relation.h"
+#include "Query.h"
+
+// test program
+// build pipeline and eager aggregation of the query engine against a plain evaluation on the raw columns
+// relation file in contest format, at least two columns
+// filter: column 1 below the middle of its range, grouped by column 0, sums of all other columns
+
+struct Group{
+	uint64_t count=0;
+	std::vector<uint64_t> sums;
+};
+
+// key the groups of column are looked up with, code for dictionary-encoded columns
+static uint64_t indexKey(const column_t &col, uint64_t value){
+	if(!col.dictionary) return value;
+	return std::lower_bound(col.dictionary, col.dictionary + col.dictionary_size, value) - col.dictionary;
+}
+
+static bool checkAggregate(const Relation &rel, const std::vector<uint64_t> *rows, unsigned threads){
+	const size_t num_columns = rel.getNumberOfColumns();
+	std::vector<unsigned> sumColumns;
+	for(unsigned c=1; c<num_columns; ++c){
+		sumColumns.push_back(c);
+	}
+	// expected groups
+	const uint64_t count = rows ? rows->size() : rel.getNumberOfTuples();
+	std::map<uint64_t,Group> expected;
+	for(uint64_t i=0; i<count; ++i){
+		const uint64_t row = rows ? (*rows)[i] : i;
+		Group &g = expected[rel.getRawColumn(0)[row]];
+		g.sums.resize(sumColumns.size());
+		++g.count;
+		for(size_t c=0; c<sumColumns.size(); ++c){
+			g.sums[c] += rel.getRawColumn(sumColumns[c])[row];
+		}
+	}
+
+	Aggregate agg;
+	rel.buildAggregate(0, sumColumns, rows, agg, threads);
+	const uint64_t groups = std::count_if(agg.counts.begin(), agg.counts.end(), [](uint64_t c){ return c != 0; });
+	if(groups != expected.size()){
+		printf("%u threads: %lu groups, expected %lu\n", threads, groups, expected.size());
+		return false;
+	}
+	for(const auto &[key, e] : expected){
+		// groups are in HTu_t or HTsu_t
+		const uint64_t k = indexKey(rel.getColumn(0), key);
+		const uint64_t g = agg.groups.index() == 2 ? std::get<HTu_t>(agg.groups).lookup(k) : std::get<HTsu_t>(agg.groups).lookup(k);
+		if(g >= agg.counts.size() || agg.counts[g] != e.count){
+			printf("%u threads: key %lu has wrong count\n", threads, key);
+			return false;
+		}
+		for(size_t c=0; c<sumColumns.size(); ++c){
+			if(agg.sums[c][g] != e.sums[c]){
+				printf("%u threads: key %lu has wrong sum of column %u\n", threads, key, sumColumns[c]);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+int main(int argc, char **argv){
+	if(argc != 2){
+		printf("usage: %s relation_file\n", argv[0]);
+		return 0;
+	}
+	Relation rel(argv[1]);
+	if(rel.getNumberOfColumns() < 2){
+		fprintf(stderr, "relation needs at least two columns\n");
+		return EXIT_FAILURE;
+	}
+	rel.stats_init();
+	for(size_t c=0; c<rel.getNumberOfColumns(); ++c){
+		rel.stats(c);
+	}
+	printf("columns: %lu; tuples: %lu\n", rel.getNumberOfColumns(), rel.getNumberOfTuples());
+
+	const ColumnInfo &info = rel.getColumnInfo(1);
+	const uint64_t constant = info.min + (info.max - info.min) / 2;
+	std::vector<Filter> filters;
+	filters.emplace_back(0, 1, constant, Filter::Less);
+	std::vector<uint64_t> expected;
+	for(uint64_t i=0; i<rel.getNumberOfTuples(); ++i){
+		if(rel.getRawColumn(1)[i] < constant){
+			expected.push_back(i);
+		}
+	}
+
+	bool ok = true;
+	for(unsigned threads : {1u, (unsigned)omp_get_max_threads()}){
+		const std::vector<uint64_t> rowids = runBuildPipeline(rel, 0, filters, threads);
+		if(rowids != expected){
+			printf("%u threads: build pipeline returned %lu rows, expected %lu\n", threads, rowids.size(), expected.size());
+			ok = false;
+		}
+		ok &= checkAggregate(rel, &expected, threads);
+		ok &= checkAggregate(rel, nullptr, threads);
+	}
+	puts(ok ? "ok" : "failed");
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,166 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "Relation.h"
+#include "Query.h"
+#include "ScanOperator.h"
+#include "ProjectionOperator.h"
+
+// test program
+// appends a batch to the first relation and compares the results of a query before and after the append
+// with the results on relations loaded from files which contain the same tuples from the start
+// indexes are built by another thread while the batch is appended
+// relation files in contest format, at least two columns each, bound to relation ids in the given order
+
+struct Result{
+	uint64_t amount;
+	std::vector<uint64_t> sums;
+};
+
+static Result run(const char *text, const std::vector<Relation> &relations){
+	std::string line(text);
+	Query q;
+	q.parse(line.data());
+	q.rewrite(relations);
+	if(q.empty){
+		return {0, {}};
+	}
+	auto [scan,proj] = q.constructPipeline(relations);
+	Context ctx(q.relationIds.size());
+	scan->execute(&ctx);
+	Result r{proj->getAmount(), proj->getResults()};
+	delete scan;
+	return r;
+}
+
+static bool same(const Result &a, const Result &b){
+	// sums are undefined without results
+	return (a.amount == 0) == (b.amount == 0) && (a.amount == 0 || a.sums == b.sums);
+}
+
+static void precalc(std::vector<Relation> &relations){
+	for(Relation &r : relations){
+		r.stats_init();
+		for(size_t c=0; c<r.getNumberOfColumns(); ++c){
+			r.stats(c);
+		}
+	}
+}
+
+// relation file in contest format
+static void writeRelation(const char *fname, const std::vector<std::vector<uint64_t>> &columns){
+	FILE *fd = fopen(fname, "wb");
+	if(!fd){
+		perror("failed to create relation");
+		exit(EXIT_FAILURE);
+	}
+	const uint64_t header[2] = {columns[0].size(), columns.size()};
+	bool ok = fwrite(header, sizeof(uint64_t), 2, fd) == 2;
+	for(const auto &col : columns){
+		ok = ok && fwrite(col.data(), sizeof(uint64_t), col.size(), fd) == col.size();
+	}
+	if(fclose(fd) != 0 || !ok){
+		perror("failed to write relation");
+		exit(EXIT_FAILURE);
+	}
+}
+
+int main(int argc, char **argv){
+	if(argc < 3){
+		printf("usage: %s relation_file relation_file...\n", argv[0]);
+		return 0;
+	}
+	std::vector<Relation> relations;
+	for(int i=1; i<argc; ++i){
+		relations.emplace_back(argv[i]);
+	}
+	for(const Relation &r : relations){
+		if(r.getNumberOfColumns() < 2){
+			fprintf(stderr, "relations need at least two columns\n");
+			return EXIT_FAILURE;
+		}
+	}
+	precalc(relations);
+
+	// batch: copies of the first tuples, join keys are no longer unique, and tuples outside the domain of each column
+	Relation &rel = relations[0];
+	const size_t num_columns = rel.getNumberOfColumns();
+	const uint64_t copies = std::min<uint64_t>(rel.getNumberOfTuples(), 100), outside = 10;
+	std::vector<std::vector<uint64_t>> columns(num_columns);
+	for(size_t c=0; c<num_columns; ++c){
+		const uint64_t *raw = rel.getRawColumn(c);
+		columns[c].assign(raw, raw + rel.getNumberOfTuples());
+	}
+	std::vector<uint64_t> tuples;
+	for(uint64_t i=0; i<copies + outside; ++i){
+		for(size_t c=0; c<num_columns; ++c){
+			const uint64_t value = i < copies ? columns[c][i] : rel.getColumnInfo(c).max + i;
+			tuples.push_back(value);
+			columns[c].push_back(value);
+		}
+	}
+	char fname[] = "/tmp/appendXXXXXX";
+	const int fd = mkstemp(fname);
+	if(fd == -1){
+		perror("failed to create temporary file");
+		return EXIT_FAILURE;
+	}
+	close(fd);
+	writeRelation(fname, columns);
+	std::vector<Relation> expected_relations;
+	expected_relations.emplace_back(fname);
+	for(int i=2; i<argc; ++i){
+		expected_relations.emplace_back(argv[i]);
+	}
+	precalc(expected_relations);
+	unlink(fname);
+
+	const ColumnInfo &info = rel.getColumnInfo(1);
+	char filtered[128];
+	snprintf(filtered, sizeof(filtered), "0 1|0.0=1.0&0.1<%lu|0.0 1.1", info.min + (info.max - info.min) / 2);
+	const char *queries[] = {
+		"0 1|0.0=1.0|0.1 1.1",
+		"1 0|0.0=1.0|0.0 1.1",
+		filtered,
+	};
+
+	std::vector<Result> before;
+	for(const char *text : queries){
+		before.push_back(run(text, relations));
+	}
+	// indexes are rebuilt concurrently, append waits for running builds and blocks new ones
+	for(size_t c=0; c<num_columns; ++c){
+		rel.evictIndex(c, INDEX_BT);
+		rel.evictIndex(c, INDEX_HT);
+	}
+	std::thread builder([&]{
+		for(size_t c=0; c<num_columns; ++c){
+			rel.ensureIndex(c, INDEX_HT);
+			rel.ensureIndex(c, INDEX_BT);
+		}
+	});
+	rel.append(tuples.data(), copies + outside);
+	builder.join();
+	printf("tuples: %lu; appended: %lu\n", rel.getNumberOfTuples(), copies + outside);
+
+	bool ok = true;
+	for(size_t i=0; i<std::size(queries); ++i){
+		const Result after = run(queries[i], relations);
+		if(!same(after, run(queries[i], expected_relations))){
+			printf("%s: results after append differ\n", queries[i]);
+			ok = false;
+		}
+		if(same(after, before[i]) && after.amount != 0){
+			printf("%s: appended tuples are missing\n", queries[i]);
+			ok = false;
+		}
+	}
+	puts(ok ? "ok" : "failed");
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
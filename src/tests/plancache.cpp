@@ -0,0 +1,164 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <string>
+
+#include <coat/Function.h>
+#include <coat/ControlFlow.h>
+
+#include "Relation.h"
+#include "Query.h"
+#include "ScanOperator.h"
+#include "ProjectionOperator.h"
+#include "PlanCache.h"
+
+// test program
+// queries of the same shape with different constants, the second one reuses the generated code of the first
+// if both get the same join order and plan, which depends on the estimated selectivity of the constants
+// results of generated code from the plan cache are compared with the tuple-by-tuple execution
+// relation files in contest format, at least two columns each, bound to relation ids in the given order
+
+struct Result{
+	uint64_t amount;
+	std::vector<uint64_t> sums;
+};
+
+static Query prepare(const char *text, const std::vector<Relation> &relations, bool &empty){
+	std::string line(text);
+	Query q;
+	q.parse(line.data());
+	q.rewrite(relations);
+	empty = q.empty;
+	return q;
+}
+
+static Result tupleByTuple(const char *text, const std::vector<Relation> &relations){
+	bool empty;
+	Query q = prepare(text, relations, empty);
+	if(empty){
+		return {0, {}};
+	}
+	auto [scan,proj] = q.constructPipeline(relations);
+	Context ctx(q.relationIds.size());
+	scan->execute(&ctx);
+	Result r{proj->getAmount(), proj->getResults()};
+	delete scan;
+	return r;
+}
+
+// join order and plan of each step, everything the shape of the pipeline depends on besides the query text
+static std::string planOf(const Query &q, const std::vector<Relation> &relations){
+	std::string plan;
+	for(unsigned relid : q.relationIds){
+		plan += std::to_string(relid) + ' ';
+	}
+	for(const Predicate &p : q.predicates){
+		plan += std::to_string(p.left.relationId) + '.' + std::to_string(p.left.columnId) + '='
+			+ std::to_string(p.right.relationId) + '.' + std::to_string(p.right.columnId) + ' ';
+	}
+	for(const JoinPlan &step : q.plan(relations)){
+		plan += std::to_string(int(step.kind)) + std::to_string(step.filtered) + std::to_string(step.used) + ' ';
+	}
+	return plan;
+}
+
+static Result cached(const char *text, const std::vector<Relation> &relations, PlanCache &cache, coat::runtimeasmjit &asmrt, std::string &plan){
+	bool empty;
+	Query q = prepare(text, relations, empty);
+	if(empty){
+		return {0, {}};
+	}
+	plan = planOf(q, relations);
+	auto [scan,proj] = q.constructPipeline(relations);
+	std::string key;
+	ParamBlock params;
+	scan->bind(params, key);
+	codegen_func_type fnptr = cache.lookup(key, params);
+	if(!fnptr){
+		coat::Function<coat::runtimeasmjit,codegen_func_type> fn(asmrt);
+		{
+			CodegenContext ctx(fn, params, q.relationIds.size(), q.selections.size());
+			scan->codegen(fn, ctx);
+			proj->codegen_save(fn, ctx);
+			coat::ret(fn, ctx.amount);
+		}
+		fnptr = fn.finalize();
+		cache.insert(std::move(key), fnptr, params);
+	}
+	Result r{0, std::vector<uint64_t>(q.selections.size())};
+	r.amount = fnptr(0, scan->getTuples(), r.sums.data());
+	delete scan;
+	return r;
+}
+
+static bool same(const Result &a, const Result &b){
+	// sums are undefined without results
+	return (a.amount == 0) == (b.amount == 0) && (a.amount == 0 || a.sums == b.sums);
+}
+
+int main(int argc, char **argv){
+	if(argc < 3){
+		printf("usage: %s relation_file relation_file...\n", argv[0]);
+		return 0;
+	}
+	std::vector<Relation> relations;
+	for(int i=1; i<argc; ++i){
+		relations.emplace_back(argv[i]);
+	}
+	for(Relation &r : relations){
+		if(r.getNumberOfColumns() < 2){
+			fprintf(stderr, "relations need at least two columns\n");
+			return EXIT_FAILURE;
+		}
+		r.stats_init();
+		for(size_t c=0; c<r.getNumberOfColumns(); ++c){
+			r.stats(c);
+		}
+	}
+
+	// constants in the range of the filtered column, different ones for each query of a shape
+	const ColumnInfo &info = relations[0].getColumnInfo(1);
+	const uint64_t constants[] = {
+		info.min + (info.max - info.min) / 2,
+		info.min + (info.max - info.min) / 4,
+	};
+	const char *shapes[] = {
+		"0 1|0.0=1.0&0.1<%lu|0.0 1.1",
+		"0 1|0.0=1.0&0.1>%lu|0.1 1.0",
+	};
+
+	coat::runtimeasmjit asmrt;
+	PlanCache cache;
+	bool ok = true;
+	size_t pinned=0;
+	for(const char *shape : shapes){
+		std::string first;
+		for(uint64_t constant : constants){
+			char text[128];
+			snprintf(text, sizeof(text), shape, constant);
+			const Result expected = tupleByTuple(text, relations);
+			std::string plan;
+			const size_t hits = cache.getHits();
+			const Result result = cached(text, relations, cache, asmrt, plan);
+			if(!same(expected, result)){
+				printf("%s: generated code differs from tuple-by-tuple\n", text);
+				ok = false;
+			}
+			// constants are parameters: the same plan has to reuse the generated code
+			if(constant != constants[0] && !plan.empty() && plan == first){
+				++pinned;
+				if(cache.getHits() == hits){
+					printf("%s: same plan as with constant %lu, but generated code was not reused\n", text, constants[0]);
+					ok = false;
+				}
+			}
+			if(constant == constants[0]){
+				first = plan;
+			}
+		}
+	}
+	printf("plan cache: %lu hits, %lu misses, %lu shapes, %lu queries with the plan of an earlier one\n", cache.getHits(), cache.getMisses(), cache.getNumberOfShapes(), pinned);
+	puts(ok ? "ok" : "failed");
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,136 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "RelationFormat.h"
+
+
+// converts a relation file of the contest format (version 1) to version 2
+// columns are narrowed to the smallest width, frame of reference if it needs a smaller width than the values
+// dictionary encoding and bit-packing are not written, minimize() applies them when loading with DICTIONARYCOL or BITPACKCOL
+
+static uint64_t bitwidth(uint64_t value){
+	return value ? 64 - __builtin_clzl(value) : 0;
+}
+
+static uint64_t typewidth(uint64_t bits){
+	if(bits <= 8) return 8;
+	if(bits <= 16) return 16;
+	if(bits <= 32) return 32;
+	return 64;
+}
+
+template<typename T>
+static bool writeColumn(FILE *fd, const uint64_t *col, uint64_t size, uint64_t base){
+	std::vector<T> narrowed(size);
+	for(uint64_t idx=0; idx<size; ++idx){
+		narrowed[idx] = col[idx] - base;
+	}
+	return fwrite(narrowed.data(), sizeof(T), size, fd) == size;
+}
+
+int main(int argc, char *argv[]){
+	if(argc != 3){
+		fprintf(stderr, "usage: %s relation_file output_file\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	int fd = open(argv[1], O_RDONLY);
+	if(fd == -1){
+		perror("failed to open relation");
+		return EXIT_FAILURE;
+	}
+	struct stat s;
+	if(fstat(fd, &s) == -1){
+		perror("failed to fstat file");
+		return EXIT_FAILURE;
+	}
+	const uint64_t fsize = s.st_size;
+	if(fsize < 2*sizeof(uint64_t)){
+		fprintf(stderr, "relation file %s does not contain a valid header\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	const char *addr = reinterpret_cast<const char*>(mmap(nullptr, fsize, PROT_READ, MAP_PRIVATE, fd, 0));
+	if(addr == MAP_FAILED){
+		perror("failed to mmap relation");
+		return EXIT_FAILURE;
+	}
+	close(fd);
+	if(isRelationV2(addr, fsize)){
+		fprintf(stderr, "relation file %s is already converted\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	const uint64_t *header = reinterpret_cast<const uint64_t*>(addr);
+	const uint64_t size = header[0], num_columns = header[1];
+	if(fsize < (2 + size*num_columns)*sizeof(uint64_t)){
+		fprintf(stderr, "relation file %s is truncated\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	// statistics and layout of columns
+	RelationHeader rheader;
+	memcpy(rheader.magic, relation_magic, sizeof(relation_magic));
+	rheader.version = relation_version;
+	rheader.size = size;
+	rheader.num_columns = num_columns;
+	std::vector<RelationColumn> formats(num_columns);
+	uint64_t offset = sizeof(RelationHeader) + num_columns*sizeof(RelationColumn);
+	for(uint64_t c=0; c<num_columns; ++c){
+		const uint64_t *col = header + 2 + c*size;
+		RelationColumn &format = formats[c];
+		std::vector<uint64_t> sorted(col, col + size);
+		std::sort(sorted.begin(), sorted.end());
+		format.min = size ? sorted.front() : 0;
+		format.max = size ? sorted.back() : 0;
+		format.distinct = std::unique(sorted.begin(), sorted.end()) - sorted.begin();
+		format.width = typewidth(bitwidth(format.max));
+		format.encoding = ENCODING_PLAIN;
+		format.base = 0;
+		if(typewidth(bitwidth(format.max - format.min)) < format.width){
+			format.width = typewidth(bitwidth(format.max - format.min));
+			format.encoding = ENCODING_OFFSET;
+			format.base = format.min;
+		}
+		offset = (offset + relation_alignment - 1) & ~(relation_alignment - 1);
+		format.offset = offset;
+		offset += size*format.width/8;
+		printf("column %lu: %lu bits%s, min: %lu, max: %lu, distinct: %lu\n",
+			c, format.width, format.encoding == ENCODING_OFFSET ? " (offset)" : "", format.min, format.max, format.distinct);
+	}
+
+	FILE *out = fopen(argv[2], "wb");
+	if(!out){
+		perror("failed to create output file");
+		return EXIT_FAILURE;
+	}
+	static const char padding[relation_alignment] = {};
+	bool ok = fwrite(&rheader, sizeof(rheader), 1, out) == 1
+		&& fwrite(formats.data(), sizeof(RelationColumn), num_columns, out) == num_columns;
+	uint64_t written = sizeof(RelationHeader) + num_columns*sizeof(RelationColumn);
+	for(uint64_t c=0; ok && c<num_columns; ++c){
+		const RelationColumn &format = formats[c];
+		const uint64_t *col = header + 2 + c*size;
+		ok = fwrite(padding, 1, format.offset - written, out) == format.offset - written;
+		switch(format.width){
+			case  8: ok = ok && writeColumn<uint8_t >(out, col, size, format.base); break;
+			case 16: ok = ok && writeColumn<uint16_t>(out, col, size, format.base); break;
+			case 32: ok = ok && writeColumn<uint32_t>(out, col, size, format.base); break;
+			default: ok = ok && writeColumn<uint64_t>(out, col, size, format.base); break;
+		}
+		written = format.offset + size*format.width/8;
+	}
+	if(fclose(out) != 0 || !ok){
+		perror("failed to write output file");
+		unlink(argv[2]);
+		return EXIT_FAILURE;
+	}
+	munmap(const_cast<char*>(addr), fsize);
+	return EXIT_SUCCESS;
+}